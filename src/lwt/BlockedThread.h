@@ -49,7 +49,10 @@ public:
         UNBLOCKED,
 
         /// The block was cancelled
-        CANCELLED
+        CANCELLED,
+
+        /// The deadline of the blocked thread has expired
+        TIMEDOUT
     } result_t;
 
 private:
@@ -75,7 +78,9 @@ public:
     ~BlockedThread();
 
     /**
-     * Block the current thread via this reference.
+     * Block the current thread via this reference. If the thread has
+     * a deadline (see Thread::DeadlineScope), the blocking ends with
+     * TIMEDOUT when the deadline expires.
      */
     result_t blockCurrent();
 
@@ -109,6 +114,7 @@ private:
     void clearThread();
 
     friend class Thread;
+    friend class WaitQueue;
 };
 
 //------------------------------------------------------------------------------
@@ -0,0 +1,457 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_CHANNEL_H
+#define LWT_CHANNEL_H
+//------------------------------------------------------------------------------
+
+#include "WaitQueue.h"
+#include "SelectCase.h"
+
+#include <cerrno>
+#include <new>
+#include <utility>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A bounded channel for passing values of type T between the
+ * threads. The values are stored in a fixed ring buffer of N
+ * elements, and the waiting senders and receivers are kept in wait
+ * queues, so the channel does not allocate any memory. The values
+ * are moved in and out of the channel, so move-only types can be
+ * used.
+ *
+ * Several values can be sent or received at once with sendBatch()
+ * and receiveBatch(), which need only one wakeup of the peer for a
+ * whole batch.
+ *
+ * A channel can be closed. After that, sending fails, but the values
+ * already in the channel can still be received. If the channel is
+ * closed and empty, receiving fails. The operations fail with errno
+ * set to EPIPE in both cases.
+ *
+ * A channel can be waited for together with other events by a
+ * Selector, using ReceiveCase and SendCase.
+ */
+template <typename T, size_t N>
+class Channel
+{
+private:
+    /**
+     * The storage of the values.
+     */
+    alignas(T) unsigned char storage[N*sizeof(T)];
+
+    /**
+     * The index of the first value.
+     */
+    size_t head;
+
+    /**
+     * The number of values in the channel.
+     */
+    size_t count;
+
+    /**
+     * Indicate if the channel is closed.
+     */
+    bool closed;
+
+    /**
+     * The threads waiting to send.
+     */
+    WaitQueue senders;
+
+    /**
+     * The threads waiting to receive.
+     */
+    WaitQueue receivers;
+
+    /**
+     * The select cases waiting for a value to receive.
+     */
+    SelectCase* receiveCases;
+
+    /**
+     * The select cases waiting for space to send.
+     */
+    SelectCase* sendCases;
+
+public:
+    /**
+     * Construct the channel.
+     */
+    Channel();
+
+    /**
+     * Destroy the channel. The values still in the channel are
+     * destroyed, and the waiting threads are cancelled.
+     */
+    ~Channel();
+
+private:
+    Channel(const Channel&);
+    Channel& operator=(const Channel&);
+
+public:
+    /**
+     * Send the given value. If the channel is full, wait for space.
+     *
+     * @return if the value has been sent. If not, errno is set to
+     * EPIPE if the channel is closed, or to ETIMEDOUT or ECANCELED
+     * if the waiting has failed. The value is left intact then.
+     */
+    bool send(T&& value);
+
+    /**
+     * Send the given value, if there is space in the channel.
+     */
+    bool trySend(T&& value);
+
+    /**
+     * Send the given values. If the channel becomes full, wait for
+     * space.
+     *
+     * @return the number of values sent. If it is less than count,
+     * errno is set like by send().
+     */
+    size_t sendBatch(T* values, size_t count);
+
+    /**
+     * Receive a value. If the channel is empty, wait for one.
+     *
+     * @return if a value has been received. If not, errno is set to
+     * EPIPE if the channel is closed, or to ETIMEDOUT or ECANCELED
+     * if the waiting has failed.
+     */
+    bool receive(T& value);
+
+    /**
+     * Receive a value, if there is one in the channel.
+     */
+    bool tryReceive(T& value);
+
+    /**
+     * Receive at most the given number of values. If the channel is
+     * empty, wait for at least one value.
+     *
+     * @return the number of values received. If it is 0, errno is
+     * set like by receive().
+     */
+    size_t receiveBatch(T* values, size_t maxCount);
+
+    /**
+     * Close the channel. The waiting threads are woken up.
+     */
+    void close();
+
+    /**
+     * Determine if the channel is closed.
+     */
+    bool isClosed() const;
+
+    /**
+     * Get the number of values in the channel.
+     */
+    size_t size() const;
+
+    /**
+     * Get the capacity of the channel.
+     */
+    static size_t capacity();
+
+    /**
+     * Register the given select case to be fired when there is a
+     * value to receive or the channel is closed.
+     */
+    void selectReceive(SelectCase& c);
+
+    /**
+     * Register the given select case to be fired when there is space
+     * to send a value or the channel is closed.
+     */
+    void selectSend(SelectCase& c);
+
+private:
+    /**
+     * Get the value at the given index.
+     */
+    T* at(size_t index);
+
+    /**
+     * Move the given value into the channel. There should be space
+     * for it.
+     */
+    void push(T& value);
+
+    /**
+     * Move the first value out of the channel into the given
+     * variable. The channel should not be empty.
+     */
+    void pop(T& value);
+
+    /**
+     * Wake up at most the given number of threads from the given
+     * queue.
+     */
+    static void notify(WaitQueue& queue, size_t n);
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline Channel<T, N>::Channel() :
+    head(0),
+    count(0),
+    closed(false),
+    receiveCases(0),
+    sendCases(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+Channel<T, N>::~Channel()
+{
+    for(; count>0; --count) {
+        at(head)->~T();
+        if (++head==N) head = 0;
+    }
+    SelectCase::fireAll(receiveCases);
+    SelectCase::fireAll(sendCases);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+bool Channel<T, N>::send(T&& value)
+{
+    while (!closed && count==N) {
+        if (!senders.wait()) return false;
+    }
+    if (closed) {
+        errno = EPIPE;
+        return false;
+    }
+
+    push(value);
+    receivers.notifyOne();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+bool Channel<T, N>::trySend(T&& value)
+{
+    if (closed || count==N) return false;
+
+    push(value);
+    receivers.notifyOne();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+size_t Channel<T, N>::sendBatch(T* values, size_t numValues)
+{
+    size_t numSent = 0;
+    while (numSent<numValues) {
+        while (!closed && count==N) {
+            if (!senders.wait()) return numSent;
+        }
+        if (closed) {
+            errno = EPIPE;
+            return numSent;
+        }
+
+        size_t n = 0;
+        for(; count<N && numSent<numValues; ++n, ++numSent) {
+            push(values[numSent]);
+        }
+        notify(receivers, n);
+    }
+    return numSent;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+bool Channel<T, N>::receive(T& value)
+{
+    while (!closed && count==0) {
+        if (!receivers.wait()) return false;
+    }
+    if (count==0) {
+        errno = EPIPE;
+        return false;
+    }
+
+    pop(value);
+    senders.notifyOne();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+bool Channel<T, N>::tryReceive(T& value)
+{
+    if (count==0) return false;
+
+    pop(value);
+    senders.notifyOne();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+size_t Channel<T, N>::receiveBatch(T* values, size_t maxCount)
+{
+    while (!closed && count==0) {
+        if (!receivers.wait()) return 0;
+    }
+    if (count==0) {
+        errno = EPIPE;
+        return 0;
+    }
+
+    size_t n = 0;
+    for(; count>0 && n<maxCount; ++n) {
+        pop(values[n]);
+    }
+    notify(senders, n);
+    return n;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+void Channel<T, N>::close()
+{
+    closed = true;
+    senders.notifyAll();
+    receivers.notifyAll();
+    SelectCase::fireAll(receiveCases);
+    SelectCase::fireAll(sendCases);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline bool Channel<T, N>::isClosed() const
+{
+    return closed;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline size_t Channel<T, N>::size() const
+{
+    return count;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline size_t Channel<T, N>::capacity()
+{
+    return N;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline void Channel<T, N>::selectReceive(SelectCase& c)
+{
+    c.link(receiveCases);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline void Channel<T, N>::selectSend(SelectCase& c)
+{
+    c.link(sendCases);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline T* Channel<T, N>::at(size_t index)
+{
+    return reinterpret_cast<T*>(storage) + index;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline void Channel<T, N>::push(T& value)
+{
+    size_t index = head + count;
+    if (index>=N) index -= N;
+    new (at(index)) T(std::move(value));
+    ++count;
+    SelectCase::fireAll(receiveCases);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline void Channel<T, N>::pop(T& value)
+{
+    T* v = at(head);
+    value = std::move(*v);
+    v->~T();
+    if (++head==N) head = 0;
+    --count;
+    SelectCase::fireAll(sendCases);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, size_t N>
+inline void Channel<T, N>::notify(WaitQueue& queue, size_t n)
+{
+    for(; n>0 && queue.notifyOne()!=0; --n) {
+    }
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_CHANNEL_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,61 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+//------------------------------------------------------------------------------
+
+#include "Clock.h"
+
+#include <time.h>
+
+//------------------------------------------------------------------------------
+
+using lwt::Clock;
+
+//------------------------------------------------------------------------------
+
+nanos_t Clock::cachedTime = currentTimeNanos();
+
+//------------------------------------------------------------------------------
+
+bool Clock::coarse = false;
+
+//------------------------------------------------------------------------------
+
+bool Clock::ticking = false;
+
+//------------------------------------------------------------------------------
+
+nanos_t Clock::update()
+{
+    if (coarse) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        cachedTime = static_cast<nanos_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+    } else {
+        cachedTime = currentTimeNanos();
+    }
+    return cachedTime;
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
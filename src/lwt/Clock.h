@@ -0,0 +1,135 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_CLOCK_H
+#define LWT_CLOCK_H
+//------------------------------------------------------------------------------
+
+#include "util.h"
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * The clock of the threads. It caches the time of the monotonic
+ * clock (the same as the one returned by currentTimeNanos()), so
+ * that it can be queried without any system or vDSO calls. The
+ * scheduler refreshes the cached time once in each iteration of its
+ * loop after waiting for events. Thus the time seen by a thread is
+ * the time when the current round of execution started.
+ */
+class Clock
+{
+private:
+    /**
+     * The cached time.
+     */
+    static nanos_t cachedTime;
+
+    /**
+     * Indicate if the coarse monotonic clock is used.
+     */
+    static bool coarse;
+
+    /**
+     * Indicate if the cached time is being refreshed regularly,
+     * i.e. the scheduler is running.
+     */
+    static bool ticking;
+
+public:
+    /**
+     * Get the cached time.
+     */
+    static nanos_t now();
+
+    /**
+     * Refresh the cached time from the kernel.
+     *
+     * @return the new time
+     */
+    static nanos_t update();
+
+    /**
+     * Get the cached time if it is refreshed regularly, otherwise
+     * refresh it first.
+     */
+    static nanos_t get();
+
+    /**
+     * Set whether CLOCK_MONOTONIC_COARSE should be used for
+     * refreshing the time. It is cheaper to read, but its resolution
+     * is only a few milliseconds, so timers with a smaller slack
+     * should not be used with it.
+     */
+    static void setCoarse(bool c);
+
+private:
+    /**
+     * Set whether the cached time is refreshed regularly.
+     */
+    static void setTicking(bool t);
+
+    friend class Scheduler;
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline nanos_t Clock::now()
+{
+    return cachedTime;
+}
+
+//------------------------------------------------------------------------------
+
+inline nanos_t Clock::get()
+{
+    return ticking ? cachedTime : update();
+}
+
+//------------------------------------------------------------------------------
+
+inline void Clock::setCoarse(bool c)
+{
+    coarse = c;
+}
+
+//------------------------------------------------------------------------------
+
+inline void Clock::setTicking(bool t)
+{
+    ticking = t;
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_CLOCK_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
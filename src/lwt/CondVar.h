@@ -0,0 +1,100 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_CONDVAR_H
+#define LWT_CONDVAR_H
+//------------------------------------------------------------------------------
+
+#include "Mutex.h"
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A condition variable for the threads. A thread holding a mutex
+ * can wait on it for a condition to become true, and other threads
+ * notify it when they have changed the condition. There are no
+ * spurious wakeups, but the condition should be checked again after
+ * waking up, since another thread may have changed it in the
+ * meantime.
+ */
+class CondVar
+{
+private:
+    /**
+     * The threads waiting for the condition.
+     */
+    WaitQueue waiters;
+
+public:
+    /**
+     * Wait for the condition. The given mutex should be locked by the
+     * current thread. It is unlocked while waiting, and locked again
+     * before returning, even if the waiting has failed.
+     *
+     * @return if the condition has been notified. If not, errno is
+     * set to ETIMEDOUT or ECANCELED.
+     */
+    bool wait(Mutex& mutex);
+
+    /**
+     * Wake up the first waiting thread.
+     *
+     * @return if there was a thread to wake up
+     */
+    bool notifyOne();
+
+    /**
+     * Wake up all waiting threads.
+     *
+     * @return the number of threads woken up
+     */
+    size_t notifyAll();
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline bool CondVar::notifyOne()
+{
+    return waiters.notifyOne()!=0;
+}
+
+//------------------------------------------------------------------------------
+
+inline size_t CondVar::notifyAll()
+{
+    return waiters.notifyAll();
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_CONDVAR_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -75,6 +75,24 @@ struct Context
 
 //------------------------------------------------------------------------------
 
+/**
+ * Prefetch the given saved context and the top of the stack it
+ * refers to, so that restoring it does not stall on cache misses.
+ */
+inline void prefetchContext(const Context& context)
+{
+#if defined(__i386__)
+    const char* sp = reinterpret_cast<const char*>(context.esp);
+#else
+    const char* sp = reinterpret_cast<const char*>(context.rsp);
+#endif
+    __builtin_prefetch(&context);
+    __builtin_prefetch(sp);
+    __builtin_prefetch(sp + 64);
+}
+
+//------------------------------------------------------------------------------
+
 } /* namespace lwt */
 
 //------------------------------------------------------------------------------
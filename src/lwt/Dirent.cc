@@ -20,11 +20,18 @@
 
 #include "Dirent.h"
 
+#include <cstring>
+
+#include <unistd.h>
+
+#include <sys/syscall.h>
+
 //------------------------------------------------------------------------------
 
 using lwt::OpenDir;
 using lwt::ReadDir;
 using lwt::CloseDir;
+using lwt::ReadDirBulk;
 
 //------------------------------------------------------------------------------
 
@@ -88,6 +95,92 @@ void CloseDir::performErrno()
     result = closedir(dirp);
 }
 
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+const unsigned ReadDirBulk::ALL_TYPES;
+
+//------------------------------------------------------------------------------
+
+ssize_t ReadDirBulk::read()
+{
+    if (IOServer::get().execute(this)) {
+        errno = getErrorNumber();
+        return result;
+    } else {
+        return -1;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void ReadDirBulk::performErrno()
+{
+    // If all entries of a buffer are filtered out, the next buffer is
+    // read, so that 0 is returned only at the end
+    ssize_t numBytes = 0;
+    result = 0;
+    while (result==0 && (numBytes = readBuffer())>0) {
+    }
+    if (numBytes<0) result = -1;
+}
+
+//------------------------------------------------------------------------------
+
+ssize_t ReadDirBulk::readBuffer()
+{
+    length = 0;
+
+    ssize_t numBytes = syscall(SYS_getdents64, fd, buffer, size);
+    if (numBytes<=0) return numBytes;
+
+    // The kept entries are moved to the beginning of the buffer
+    off64_t lastOffset = 0;
+    size_t offset = 0;
+    while (offset<static_cast<size_t>(numBytes)) {
+        struct dirent64* entry =
+            reinterpret_cast<struct dirent64*>(buffer + offset);
+        unsigned short recordLength = entry->d_reclen;
+        off64_t entryOffset = entry->d_off;
+        const char* name = entry->d_name;
+
+        bool keep =
+            strcmp(name, ".")!=0 && strcmp(name, "..")!=0 &&
+            (entry->d_type==DT_UNKNOWN || (types&typeBit(entry->d_type))!=0);
+
+        if (keep && stats!=0 && static_cast<size_t>(result)==maxStats) {
+            // No room for the status, so continue from this entry
+            // next time
+            lseek(fd, lastOffset, SEEK_SET);
+            break;
+        }
+
+        if (keep) {
+            if (length!=offset) memmove(buffer + length, entry, recordLength);
+            entry = reinterpret_cast<struct dirent64*>(buffer + length);
+            length += recordLength;
+
+            if (stats!=0) {
+                struct statx& stx = stats[result];
+                if (statx(fd, entry->d_name, statxFlags, statxMask, &stx)<0) {
+                    stx.stx_mask = 0;
+                } else if (entry->d_type==DT_UNKNOWN &&
+                           (stx.stx_mask&STATX_TYPE)!=0)
+                {
+                    entry->d_type = IFTODT(stx.stx_mode);
+                }
+            }
+
+            ++result;
+        }
+
+        lastOffset = entryOffset;
+        offset += recordLength;
+    }
+
+    return numBytes;
+}
+
 //------------------------------------------------------------------------------
 
 // Local Variables:
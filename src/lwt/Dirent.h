@@ -25,6 +25,8 @@
 #include <cerrno>
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 //------------------------------------------------------------------------------
 
@@ -158,6 +160,154 @@ protected:
     virtual void performErrno();
 };
 
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+/**
+ * An operation to read many entries of a directory in one round trip
+ * to the I/O server using getdents64(). The entries are read into a
+ * buffer provided by the caller, and they can be iterated over by
+ * getFirst() and getNext(). The "." and ".." entries are skipped.
+ *
+ * Optionally, the entries can be filtered by their type, and the
+ * extended status of each entry can be queried by statx() in the
+ * same round trip. The operation is performed in the BULK lane.
+ *
+ * Usage:
+ *
+ *   int fd = FileSystem::open(path, O_RDONLY|O_DIRECTORY);
+ *   ReadDirBulk reader(fd, buffer, sizeof(buffer));
+ *   reader.setTypes(ReadDirBulk::typeBit(DT_REG));
+ *   while (reader.read()>0) {
+ *       for(struct dirent64* e = reader.getFirst(); e!=0;
+ *           e = reader.getNext(e)) ...
+ *   }
+ */
+class ReadDirBulk : public IOServer::ErrnoOperation
+{
+public:
+    /**
+     * The type mask matching all types.
+     */
+    static const unsigned ALL_TYPES = ~0u;
+
+    /**
+     * Get the bit of the type mask for the given directory entry
+     * type (DT_xxx).
+     */
+    static unsigned typeBit(unsigned char type);
+
+private:
+    /**
+     * The file descriptor of the directory.
+     */
+    int fd;
+
+    /**
+     * The buffer.
+     */
+    char* buffer;
+
+    /**
+     * The size of the buffer.
+     */
+    size_t size;
+
+    /**
+     * The mask of the types of entries to return.
+     */
+    unsigned types;
+
+    /**
+     * The array to put the results of statx() into, if any.
+     */
+    struct statx* stats;
+
+    /**
+     * The number of elements in the stats array.
+     */
+    size_t maxStats;
+
+    /**
+     * The mask to pass to statx().
+     */
+    unsigned statxMask;
+
+    /**
+     * The flags to pass to statx().
+     */
+    int statxFlags;
+
+    /**
+     * The number of bytes of entries in the buffer.
+     */
+    size_t length;
+
+    /**
+     * The result: the number of entries read, or -1.
+     */
+    ssize_t result;
+
+public:
+    /**
+     * Construct the operation for the given directory file descriptor
+     * and buffer. The buffer should be aligned to 8 bytes and it
+     * should be large enough for at least one entry (e.g. 64 KiB).
+     */
+    ReadDirBulk(int fd, void* buffer, size_t size);
+
+    /**
+     * Set the mask of the types of the entries to return. It is a
+     * bitwise OR of typeBit() values. Entries of unknown type
+     * (DT_UNKNOWN) are always returned, since the file system may not
+     * provide the type. If their status is queried, their type is
+     * set from the status.
+     */
+    void setTypes(unsigned t);
+
+    /**
+     * Request the extended status of each entry returned. At most
+     * maxCount entries are returned by a read(), and the status of
+     * the i-th entry is put into s[i]. If statx() fails for an entry,
+     * the stx_mask of its status is 0.
+     */
+    void setStatx(struct statx* s, size_t maxCount,
+                  unsigned mask = STATX_BASIC_STATS,
+                  int flags = AT_SYMLINK_NOFOLLOW);
+
+    /**
+     * Read the next set of entries.
+     *
+     * @return the number of entries read, 0 at the end of the
+     * directory, or -1 on error.
+     */
+    ssize_t read();
+
+    /**
+     * Get the first entry of the last read, or 0 if there are none.
+     */
+    struct dirent64* getFirst() const;
+
+    /**
+     * Get the entry after the given one, or 0 if it was the last one.
+     */
+    struct dirent64* getNext(struct dirent64* entry) const;
+
+protected:
+    /**
+     * Perform the operation in the worker thread.
+     */
+    virtual void performErrno();
+
+private:
+    /**
+     * Read a buffer of entries, and filter them.
+     *
+     * @return the number of bytes read, 0 at the end, or -1 on error
+     */
+    ssize_t readBuffer();
+};
+
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 // Inline definitions
@@ -208,6 +358,66 @@ inline int CloseDir::getResult() const
     return result;
 }
 
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline unsigned ReadDirBulk::typeBit(unsigned char type)
+{
+    return 1u << type;
+}
+
+//------------------------------------------------------------------------------
+
+inline ReadDirBulk::ReadDirBulk(int fd, void* buffer, size_t size) :
+    IOServer::ErrnoOperation(IOServer::BULK),
+    fd(fd),
+    buffer(reinterpret_cast<char*>(buffer)),
+    size(size),
+    types(ALL_TYPES),
+    stats(0),
+    maxStats(0),
+    statxMask(0),
+    statxFlags(0),
+    length(0),
+    result(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline void ReadDirBulk::setTypes(unsigned t)
+{
+    types = t;
+}
+
+//------------------------------------------------------------------------------
+
+inline void ReadDirBulk::setStatx(struct statx* s, size_t maxCount,
+                                  unsigned mask, int flags)
+{
+    assert(s==0 || maxCount>0);
+    stats = s;
+    maxStats = maxCount;
+    statxMask = mask;
+    statxFlags = flags;
+}
+
+//------------------------------------------------------------------------------
+
+inline struct dirent64* ReadDirBulk::getFirst() const
+{
+    return (length>0) ? reinterpret_cast<struct dirent64*>(buffer) : 0;
+}
+
+//------------------------------------------------------------------------------
+
+inline struct dirent64* ReadDirBulk::getNext(struct dirent64* entry) const
+{
+    char* next = reinterpret_cast<char*>(entry) + entry->d_reclen;
+    return (next<(buffer + length)) ?
+        reinterpret_cast<struct dirent64*>(next) : 0;
+}
+
 //------------------------------------------------------------------------------
 
 } /* namespace lwt */
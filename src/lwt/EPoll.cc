@@ -24,6 +24,7 @@
 
 #include <cstring>
 #include <cerrno>
+#include <climits>
 // #include <cstdio>
 
 //------------------------------------------------------------------------------
@@ -52,19 +53,27 @@ void EPoll::destroy(PolledFD* polledFD)
 //------------------------------------------------------------------------------
 
 int EPoll::wait(bool& hadEvents, int timeout)
+{
+    return waitNanos(hadEvents,
+                     (timeout<0) ? INVALID_NANOS : (timeout*NANOS_PER_MILLI));
+}
+
+//------------------------------------------------------------------------------
+
+int EPoll::waitNanos(bool& hadEvents, nanos_t timeout)
 {
     static const size_t NUM_EVENTS=16;
 
     uint32_t eventMask = 0;
     PolledFD::updateAllEvents(eventMask);
-    hadEvents = eventMask!=0 || timeout>=0;
+    hadEvents = eventMask!=0 || timeout!=INVALID_NANOS;
     if (!hadEvents) return 0;
 
     struct epoll_event events[NUM_EVENTS];
     
     memset(events, 0, sizeof(events));
     errno = 0;
-    int a = epoll_wait(epfd, events, NUM_EVENTS, timeout);
+    int a = pwait(events, NUM_EVENTS, timeout);
     // Log::debug("epoll_wait: timeout=%d, a=%d, errno=%d\n", timeout,
     //            a, errno);
     if (a>=0) {
@@ -92,3 +101,32 @@ int EPoll::wait(bool& hadEvents, int timeout)
 }
 
 //------------------------------------------------------------------------------
+
+int EPoll::pwait(struct epoll_event* events, int maxEvents, nanos_t timeout)
+{
+#ifdef HAVE_EPOLL_PWAIT2
+    static bool hasPWait2 = true;
+
+    if (hasPWait2) {
+        struct timespec ts;
+        if (timeout!=INVALID_NANOS) {
+            ts.tv_sec = timeout / 1000000000;
+            ts.tv_nsec = timeout % 1000000000;
+        }
+        int a = epoll_pwait2(epfd, events, maxEvents,
+                             (timeout==INVALID_NANOS) ? 0 : &ts, 0);
+        if (a>=0 || errno!=ENOSYS) return a;
+        hasPWait2 = false;
+        errno = 0;
+    }
+#endif
+
+    int ms = -1;
+    if (timeout!=INVALID_NANOS) {
+        nanos_t millis = (timeout + NANOS_PER_MILLI - 1) / NANOS_PER_MILLI;
+        ms = (millis>INT_MAX) ? INT_MAX : static_cast<int>(millis);
+    }
+    return epoll_wait(epfd, events, maxEvents, ms);
+}
+
+//------------------------------------------------------------------------------
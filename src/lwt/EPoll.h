@@ -21,12 +21,18 @@
 #define LWT_EPOLL_H
 //------------------------------------------------------------------------------
 
+#include "util.h"
+
 #include <set>
 
 #include <inttypes.h>
 
 //------------------------------------------------------------------------------
 
+struct epoll_event;
+
+//------------------------------------------------------------------------------
+
 namespace lwt {
 
 //------------------------------------------------------------------------------
@@ -102,11 +108,31 @@ public:
     void destroy(PolledFD* polledFD);
 
     /**
-     * Wait for events with the given timeout. Any events received
-     * will be processed, i.e. the corresponding file descriptors will
-     * be called.
+     * Wait for events with the given timeout in milliseconds. Any
+     * events received will be processed, i.e. the corresponding file
+     * descriptors will be called.
+     *
+     * It calls waitNanos(), which is the function called by the
+     * scheduler, so it is final: subclasses should override
+     * waitNanos() instead.
+     */
+    virtual int wait(bool& hadEvents, int timeout = -1) final;
+
+    /**
+     * Wait for events with the given timeout in nanoseconds. If the
+     * timeout is INVALID_NANOS, there is no timeout. This is the
+     * function called by the scheduler, and it replaces wait() as the
+     * function to override for customizing the waiting. Where the
+     * kernel supports epoll_pwait2(), the timeout is kept with its
+     * full resolution, otherwise it is rounded up to milliseconds.
+     */
+    virtual int waitNanos(bool& hadEvents, nanos_t timeout = INVALID_NANOS);
+
+private:
+    /**
+     * Call epoll_pwait2() or epoll_wait() with the given timeout.
      */
-    virtual int wait(bool& hadEvents, int timeout = -1);
+    int pwait(struct epoll_event* events, int maxEvents, nanos_t timeout);
 };
 
 //------------------------------------------------------------------------------
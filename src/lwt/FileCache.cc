@@ -0,0 +1,670 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+//------------------------------------------------------------------------------
+
+#include "FileCache.h"
+
+#include "Clock.h"
+#include "EPoll.h"
+#include "FileSystem.h"
+#include "Inotify.h"
+#include "WaitQueue.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+
+//------------------------------------------------------------------------------
+
+using lwt::FileCache;
+using lwt::Inotify;
+using lwt::FileSystem;
+using lwt::WaitQueue;
+
+//------------------------------------------------------------------------------
+
+struct FileCache::Entry
+{
+    /// The path of the file
+    std::string path;
+
+    /// The hash of the path
+    size_t hash;
+
+    /// The name of the file within its directory (points into path)
+    const char* name;
+
+    /// The previous entry in the LRU list
+    Entry* previous;
+
+    /// The next entry in the LRU list
+    Entry* next;
+
+    /// The watched directory of the entry, if any
+    Directory* directory;
+
+    /// The previous entry of the directory
+    Entry* previousInDirectory;
+
+    /// The next entry of the directory
+    Entry* nextInDirectory;
+
+    /// The number of threads using the entry
+    size_t numPins;
+
+    /// The generation of the entry, incremented on each
+    /// invalidation. A result obtained while the entry was
+    /// invalidated is returned, but it is not cached.
+    unsigned generation;
+
+    /// Indicate if the status is being queried
+    bool statPending;
+
+    /// The time until the status is valid
+    nanos_t statExpiry;
+
+    /// The result of stat()
+    int statResult;
+
+    /// The error number of stat()
+    int statError;
+
+    /// The status
+    struct stat st;
+
+    /// Indicate if the file is being opened
+    bool openPending;
+
+    /// The time until the open result is valid
+    nanos_t openExpiry;
+
+    /// The error number of open()
+    int openError;
+
+    /// The descriptor, if the file could be opened
+    Descriptor* descriptor;
+
+    /// The threads waiting for a pending result
+    WaitQueue waiters;
+
+    /**
+     * Construct the entry.
+     */
+    Entry(const char* path, size_t hash);
+};
+
+//------------------------------------------------------------------------------
+
+FileCache::Entry::Entry(const char* path, size_t hash) :
+    path(path),
+    hash(hash),
+    previous(0),
+    next(0),
+    directory(0),
+    previousInDirectory(0),
+    nextInDirectory(0),
+    numPins(0),
+    generation(0),
+    statPending(false),
+    statExpiry(0),
+    statResult(-1),
+    statError(0),
+    openPending(false),
+    openExpiry(0),
+    openError(0),
+    descriptor(0)
+{
+    size_t slash = this->path.rfind('/');
+    name = this->path.c_str() + ((slash==std::string::npos) ? 0 : (slash+1));
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+struct FileCache::Directory
+{
+    /// The watch descriptor
+    int wd;
+
+    /// The paths the directory is known by
+    std::vector<std::string> paths;
+
+    /// The first entry of the directory
+    Entry* firstEntry;
+};
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+class FileCache::Watcher : public Inotify
+{
+public:
+    /**
+     * The events watched for in the directories.
+     */
+    static const uint32_t MASK =
+        IN_ATTRIB|IN_MODIFY|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|
+        IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR;
+
+private:
+    /**
+     * The cache.
+     */
+    FileCache& cache;
+
+public:
+    /**
+     * Construct the watcher.
+     */
+    Watcher(FileCache& cache);
+
+protected:
+    /**
+     * Read the events and pass them to the cache.
+     */
+    virtual void handleEvents(uint32_t events);
+
+    /**
+     * The file descriptor is registered for EPOLLIN, but the event is
+     * not reported, since the scheduler should not keep running just
+     * because of the cache.
+     */
+    virtual int updateEvents(uint32_t& events);
+};
+
+//------------------------------------------------------------------------------
+
+const uint32_t FileCache::Watcher::MASK;
+
+//------------------------------------------------------------------------------
+
+FileCache::Watcher::Watcher(FileCache& cache) :
+    cache(cache)
+{
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::Watcher::handleEvents(uint32_t /*events*/)
+{
+    while (readAvailableEvents()>0) {
+        const struct inotify_event* event;
+        while ((event = nextEvent())!=0) {
+            cache.handleEvent(event->wd, event->mask,
+                              (event->len>0) ? event->name : 0);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int FileCache::Watcher::updateEvents(uint32_t& /*events*/)
+{
+    requestedEvents = EPOLLIN;
+    uint32_t registeredEvents = 0;
+    return PolledFD::updateEvents(registeredEvents);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+const nanos_t FileCache::DEFAULT_TTL;
+
+//------------------------------------------------------------------------------
+
+const size_t FileCache::DEFAULT_MAX_ENTRIES;
+
+//------------------------------------------------------------------------------
+
+size_t FileCache::hash(const char* path)
+{
+    // FNV-1a
+    size_t h = 14695981039346656037ULL;
+    for(; *path!=0; ++path) {
+        h ^= static_cast<unsigned char>(*path);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+//------------------------------------------------------------------------------
+
+FileCache::FileCache(nanos_t ttl, size_t maxEntries) :
+    ttl(ttl),
+    maxEntries(maxEntries),
+    firstEntry(0),
+    lastEntry(0),
+    watcher(0)
+{
+    watcher = new Watcher(*this);
+    if (!watcher->isOpen()) {
+        EPoll::get().destroy(watcher);
+        watcher = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+FileCache::~FileCache()
+{
+    while (firstEntry!=0) remove(firstEntry);
+    if (watcher!=0) EPoll::get().destroy(watcher);
+}
+
+//------------------------------------------------------------------------------
+
+int FileCache::stat(const char* path, struct stat* st)
+{
+    Entry* entry = acquire(path);
+
+    int result = -1;
+    while (true) {
+        if (entry->statExpiry>Clock::now()) {
+            result = entry->statResult;
+            if (result==0) {
+                *st = entry->st;
+            } else {
+                errno = entry->statError;
+            }
+            break;
+        } else if (!entry->statPending) {
+            entry->statPending = true;
+            unsigned generation = entry->generation;
+
+            watch(entry);
+
+            struct stat s;
+            result = FileSystem::stat(entry->path.c_str(), &s);
+            int errorNumber = errno;
+
+            entry->statPending = false;
+            // A failure of the I/O server itself is not cached
+            if (result==0 ||
+                (errorNumber!=ETIMEDOUT && errorNumber!=ECANCELED))
+            {
+                entry->statResult = result;
+                entry->statError = errorNumber;
+                entry->st = s;
+                entry->statExpiry = (generation==entry->generation) ?
+                    (Clock::now() + ttl) : 0;
+            }
+            entry->waiters.notifyAll();
+
+            if (result==0) *st = s;
+            errno = errorNumber;
+            break;
+        } else if (!entry->waiters.wait()) {
+            break;
+        }
+    }
+
+    release(entry);
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool FileCache::open(const char* path, Handle& handle)
+{
+    Entry* entry = acquire(path);
+
+    bool result = false;
+    while (true) {
+        if (entry->openExpiry>Clock::now()) {
+            if (entry->descriptor!=0) {
+                handle.set(entry->descriptor);
+                result = true;
+            } else {
+                errno = entry->openError;
+            }
+            break;
+        } else if (!entry->openPending) {
+            entry->openPending = true;
+            unsigned generation = entry->generation;
+
+            watch(entry);
+
+            int fd = FileSystem::open(entry->path.c_str(),
+                                      O_RDONLY|O_CLOEXEC);
+            int errorNumber = errno;
+
+            entry->openPending = false;
+            if (fd>=0 || (errorNumber!=ETIMEDOUT && errorNumber!=ECANCELED)) {
+                retire(entry);
+                if (fd>=0) {
+                    Descriptor* descriptor = new Descriptor;
+                    descriptor->fd = fd;
+                    descriptor->numHandles = 0;
+                    descriptor->retired = false;
+                    entry->descriptor = descriptor;
+                    handle.set(descriptor);
+                    result = true;
+                }
+                entry->openError = errorNumber;
+                entry->openExpiry = (generation==entry->generation) ?
+                    (Clock::now() + ttl) : 0;
+            }
+            entry->waiters.notifyAll();
+
+            errno = errorNumber;
+            break;
+        } else if (!entry->waiters.wait()) {
+            break;
+        }
+    }
+
+    release(entry);
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::invalidate(const char* path)
+{
+    Entry* entry = find(path, hash(path));
+    if (entry!=0) invalidate(entry);
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::invalidateAll()
+{
+    for(Entry* entry = firstEntry; entry!=0; entry = entry->next) {
+        invalidate(entry);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+FileCache::Entry* FileCache::acquire(const char* path)
+{
+    size_t h = hash(path);
+    Entry* entry = find(path, h);
+    if (entry==0) {
+        entry = new Entry(path, h);
+        entries.insert(entries_t::value_type(h, entry));
+    } else if (entry!=firstEntry) {
+        // Unlink, so that it is moved to the front
+        entry->previous->next = entry->next;
+        if (entry->next==0) {
+            lastEntry = entry->previous;
+        } else {
+            entry->next->previous = entry->previous;
+        }
+    }
+
+    if (entry!=firstEntry) {
+        entry->previous = 0;
+        entry->next = firstEntry;
+        if (firstEntry==0) {
+            lastEntry = entry;
+        } else {
+            firstEntry->previous = entry;
+        }
+        firstEntry = entry;
+    }
+
+    ++entry->numPins;
+
+    if (entries.size()>maxEntries) evict();
+
+    return entry;
+}
+
+//------------------------------------------------------------------------------
+
+inline void FileCache::release(Entry* entry)
+{
+    --entry->numPins;
+}
+
+//------------------------------------------------------------------------------
+
+FileCache::Entry* FileCache::find(const char* path, size_t h)
+{
+    std::pair<entries_t::iterator, entries_t::iterator> range =
+        entries.equal_range(h);
+    for(entries_t::iterator i = range.first; i!=range.second; ++i) {
+        if (i->second->path==path) return i->second;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::evict()
+{
+    Entry* entry = lastEntry;
+    while (entry!=0 && entries.size()>maxEntries) {
+        Entry* previous = entry->previous;
+        if (entry->numPins==0) remove(entry);
+        entry = previous;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::remove(Entry* entry)
+{
+    assert(entry->numPins==0);
+
+    if (entry->previous==0) {
+        firstEntry = entry->next;
+    } else {
+        entry->previous->next = entry->next;
+    }
+    if (entry->next==0) {
+        lastEntry = entry->previous;
+    } else {
+        entry->next->previous = entry->previous;
+    }
+
+    std::pair<entries_t::iterator, entries_t::iterator> range =
+        entries.equal_range(entry->hash);
+    for(entries_t::iterator i = range.first; i!=range.second; ++i) {
+        if (i->second==entry) {
+            entries.erase(i);
+            break;
+        }
+    }
+
+    unwatch(entry);
+    retire(entry);
+
+    delete entry;
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::invalidate(Entry* entry)
+{
+    ++entry->generation;
+    entry->statExpiry = 0;
+    entry->openExpiry = 0;
+    retire(entry);
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::retire(Entry* entry)
+{
+    Descriptor* descriptor = entry->descriptor;
+    if (descriptor!=0) {
+        entry->descriptor = 0;
+        descriptor->retired = true;
+        if (descriptor->numHandles==0) {
+            ::close(descriptor->fd);
+            delete descriptor;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::watch(Entry* entry)
+{
+    if (watcher==0 || entry->directory!=0) return;
+
+    std::string path(entry->path.c_str(), entry->name);
+    if (path.empty()) {
+        path = ".";
+    } else if (path.size()>1) {
+        path.resize(path.size()-1);
+    }
+
+    Directory* directory = 0;
+    directoriesByPath_t::iterator i = directoriesByPath.find(path);
+    if (i==directoriesByPath.end()) {
+        int wd = watcher->addWatch(path.c_str(), Watcher::MASK);
+        if (wd<0) return;
+
+        // The same directory may have been added under another path
+        directoriesByWatch_t::iterator j = directoriesByWatch.find(wd);
+        if (j==directoriesByWatch.end()) {
+            directory = new Directory;
+            directory->wd = wd;
+            directory->firstEntry = 0;
+            directoriesByWatch.insert(std::make_pair(wd, directory));
+        } else {
+            directory = j->second;
+        }
+
+        if (directoriesByPath.insert(std::make_pair(path, directory)).second)
+        {
+            directory->paths.push_back(path);
+        }
+
+        // Another thread may have watched the entry in the meantime
+        if (entry->directory!=0) {
+            if (directory->firstEntry==0) {
+                watcher->removeWatch(directory->wd);
+                remove(directory);
+            }
+            return;
+        }
+    } else {
+        directory = i->second;
+    }
+
+    entry->directory = directory;
+    entry->previousInDirectory = 0;
+    entry->nextInDirectory = directory->firstEntry;
+    if (directory->firstEntry!=0) {
+        directory->firstEntry->previousInDirectory = entry;
+    }
+    directory->firstEntry = entry;
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::unwatch(Entry* entry)
+{
+    Directory* directory = entry->directory;
+    if (directory==0) return;
+
+    if (entry->previousInDirectory==0) {
+        directory->firstEntry = entry->nextInDirectory;
+    } else {
+        entry->previousInDirectory->nextInDirectory = entry->nextInDirectory;
+    }
+    if (entry->nextInDirectory!=0) {
+        entry->nextInDirectory->previousInDirectory =
+            entry->previousInDirectory;
+    }
+    entry->directory = 0;
+    entry->previousInDirectory = entry->nextInDirectory = 0;
+
+    if (directory->firstEntry==0) {
+        watcher->removeWatch(directory->wd);
+        remove(directory);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::remove(Directory* directory)
+{
+    for(Entry* entry = directory->firstEntry; entry!=0;) {
+        Entry* next = entry->nextInDirectory;
+        entry->directory = 0;
+        entry->previousInDirectory = entry->nextInDirectory = 0;
+        entry = next;
+    }
+
+    for(std::vector<std::string>::iterator i = directory->paths.begin();
+        i!=directory->paths.end(); ++i)
+    {
+        directoriesByPath.erase(*i);
+    }
+    directoriesByWatch.erase(directory->wd);
+
+    delete directory;
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::handleEvent(int wd, uint32_t mask, const char* name)
+{
+    if ((mask&IN_Q_OVERFLOW)!=0) {
+        invalidateAll();
+        return;
+    }
+
+    directoriesByWatch_t::iterator i = directoriesByWatch.find(wd);
+    if (i==directoriesByWatch.end()) return;
+
+    Directory* directory = i->second;
+    for(Entry* entry = directory->firstEntry; entry!=0;
+        entry = entry->nextInDirectory)
+    {
+        if (name==0 || strcmp(entry->name, name)==0) invalidate(entry);
+    }
+
+    // The watch has been removed, e.g. because the directory has been
+    // deleted
+    if ((mask&IN_IGNORED)!=0) remove(directory);
+}
+
+//------------------------------------------------------------------------------
+
+void FileCache::release(Descriptor* descriptor)
+{
+    if (--descriptor->numHandles==0 && descriptor->retired) {
+        // Closing a read-only file does not block
+        ::close(descriptor->fd);
+        delete descriptor;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
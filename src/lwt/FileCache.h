@@ -0,0 +1,428 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+#ifndef LWT_FILECACHE_H
+#define LWT_FILECACHE_H
+//------------------------------------------------------------------------------
+
+#include "util.h"
+
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A cache of the status and of read-only file descriptors of files,
+ * to be used by the threads of the scheduler.
+ *
+ * The requests for the same path are coalesced: if a thread requests
+ * the status of a file while another one is already querying it, the
+ * thread waits for the result of the first one instead of issuing
+ * its own operation. The results, including the failures, are kept
+ * for a TTL. In addition, the directories of the cached files are
+ * watched by inotify, and an entry is invalidated whenever its file
+ * changes.
+ *
+ * The least recently used entries are evicted, if there are more than
+ * a maximal number of them.
+ */
+class FileCache
+{
+public:
+    /**
+     * The default time the results are kept for.
+     */
+    static const nanos_t DEFAULT_TTL = 1000*NANOS_PER_MILLI;
+
+    /**
+     * The default maximal number of entries.
+     */
+    static const size_t DEFAULT_MAX_ENTRIES = 4096;
+
+private:
+    /**
+     * A cached file descriptor. It is closed when it is no longer
+     * cached and no handle refers to it.
+     */
+    struct Descriptor
+    {
+        /// The file descriptor
+        int fd;
+
+        /// The number of handles referring to the descriptor
+        size_t numHandles;
+
+        /// Indicate if the descriptor has been removed from the cache
+        bool retired;
+    };
+
+    /**
+     * A cache entry.
+     */
+    struct Entry;
+
+    /**
+     * A watched directory.
+     */
+    struct Directory;
+
+    /**
+     * The inotify file descriptor.
+     */
+    class Watcher;
+
+public:
+    /**
+     * A handle of a cached file descriptor. While the handle refers to
+     * the descriptor, it is not closed, even if it is removed from
+     * the cache.
+     */
+    class Handle
+    {
+    private:
+        /**
+         * The descriptor, if any.
+         */
+        Descriptor* descriptor;
+
+    public:
+        /**
+         * Construct an empty handle.
+         */
+        Handle();
+
+        /**
+         * Move the given handle into this one.
+         */
+        Handle(Handle&& other);
+
+        /**
+         * Destroy the handle by releasing the descriptor.
+         */
+        ~Handle();
+
+        /**
+         * Release the current descriptor, and move the given handle
+         * into this one.
+         */
+        Handle& operator=(Handle&& other);
+
+    private:
+        Handle(const Handle&);
+        Handle& operator=(const Handle&);
+
+    public:
+        /**
+         * Determine if the handle refers to a descriptor.
+         */
+        bool isValid() const;
+
+        /**
+         * Get the file descriptor, or -1 if the handle is empty.
+         */
+        int getFD() const;
+
+        /**
+         * Release the descriptor.
+         */
+        void release();
+
+    private:
+        /**
+         * Refer to the given descriptor.
+         */
+        void set(Descriptor* d);
+
+        friend class FileCache;
+    };
+
+private:
+    /**
+     * Type for the entries by the hash of their paths.
+     */
+    typedef std::unordered_multimap<size_t, Entry*> entries_t;
+
+    /**
+     * Type for the directories by their paths.
+     */
+    typedef std::unordered_map<std::string, Directory*> directoriesByPath_t;
+
+    /**
+     * Type for the directories by their watch descriptors.
+     */
+    typedef std::unordered_map<int, Directory*> directoriesByWatch_t;
+
+    /**
+     * Get the hash of the given path.
+     */
+    static size_t hash(const char* path);
+
+    /**
+     * The time the results are kept for.
+     */
+    nanos_t ttl;
+
+    /**
+     * The maximal number of entries.
+     */
+    size_t maxEntries;
+
+    /**
+     * The entries.
+     */
+    entries_t entries;
+
+    /**
+     * The most recently used entry.
+     */
+    Entry* firstEntry;
+
+    /**
+     * The least recently used entry.
+     */
+    Entry* lastEntry;
+
+    /**
+     * The watched directories by their paths.
+     */
+    directoriesByPath_t directoriesByPath;
+
+    /**
+     * The watched directories by their watch descriptors.
+     */
+    directoriesByWatch_t directoriesByWatch;
+
+    /**
+     * The inotify file descriptor, or 0 if inotify is not available.
+     */
+    Watcher* watcher;
+
+public:
+    /**
+     * Construct the cache.
+     */
+    FileCache(nanos_t ttl = DEFAULT_TTL,
+              size_t maxEntries = DEFAULT_MAX_ENTRIES);
+
+    /**
+     * Destroy the cache. No thread should be using it. The cached
+     * file descriptors are closed, except for the ones still referred
+     * to by handles.
+     */
+    ~FileCache();
+
+private:
+    FileCache(const FileCache&);
+    FileCache& operator=(const FileCache&);
+
+public:
+    /**
+     * Get the status of the file with the given path like stat().
+     * The deadline and the cancellation of the current thread are
+     * obeyed like by IOServer::execute().
+     */
+    int stat(const char* path, struct stat* st);
+
+    /**
+     * Get a handle of a read-only file descriptor of the file with the
+     * given path. The file descriptor is shared, so it should be used
+     * with calls like pread() or sendfile() that do not change its
+     * offset.
+     *
+     * @return if the file could be opened. If not, errno is set like
+     * by open().
+     */
+    bool open(const char* path, Handle& handle);
+
+    /**
+     * Invalidate the entry of the given path, if any.
+     */
+    void invalidate(const char* path);
+
+    /**
+     * Invalidate all entries.
+     */
+    void invalidateAll();
+
+    /**
+     * Get the number of entries.
+     */
+    size_t size() const;
+
+private:
+    /**
+     * Find the entry for the given path, or create one, if there is
+     * none. The entry is pinned, so it is not evicted while being
+     * used.
+     */
+    Entry* acquire(const char* path);
+
+    /**
+     * Unpin the given entry.
+     */
+    void release(Entry* entry);
+
+    /**
+     * Find the entry with the given path.
+     */
+    Entry* find(const char* path, size_t h);
+
+    /**
+     * Evict the least recently used entries until there are at most
+     * the maximal number of them.
+     */
+    void evict();
+
+    /**
+     * Remove the given entry.
+     */
+    void remove(Entry* entry);
+
+    /**
+     * Invalidate the given entry.
+     */
+    void invalidate(Entry* entry);
+
+    /**
+     * Retire the descriptor of the given entry.
+     */
+    static void retire(Entry* entry);
+
+    /**
+     * Make sure the directory of the given entry is watched.
+     */
+    void watch(Entry* entry);
+
+    /**
+     * Stop watching the directory of the given entry.
+     */
+    void unwatch(Entry* entry);
+
+    /**
+     * Remove the given directory.
+     */
+    void remove(Directory* directory);
+
+    /**
+     * Handle the given inotify event.
+     */
+    void handleEvent(int wd, uint32_t mask, const char* name);
+
+    /**
+     * Release the given descriptor by a handle.
+     */
+    static void release(Descriptor* descriptor);
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline FileCache::Handle::Handle() :
+    descriptor(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline FileCache::Handle::Handle(Handle&& other) :
+    descriptor(other.descriptor)
+{
+    other.descriptor = 0;
+}
+
+//------------------------------------------------------------------------------
+
+inline FileCache::Handle::~Handle()
+{
+    release();
+}
+
+//------------------------------------------------------------------------------
+
+inline FileCache::Handle& FileCache::Handle::operator=(Handle&& other)
+{
+    if (&other!=this) {
+        release();
+        descriptor = other.descriptor;
+        other.descriptor = 0;
+    }
+    return *this;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool FileCache::Handle::isValid() const
+{
+    return descriptor!=0;
+}
+
+//------------------------------------------------------------------------------
+
+inline int FileCache::Handle::getFD() const
+{
+    return (descriptor==0) ? -1 : descriptor->fd;
+}
+
+//------------------------------------------------------------------------------
+
+inline void FileCache::Handle::release()
+{
+    if (descriptor!=0) {
+        FileCache::release(descriptor);
+        descriptor = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline void FileCache::Handle::set(Descriptor* d)
+{
+    release();
+    descriptor = d;
+    ++descriptor->numHandles;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline size_t FileCache::size() const
+{
+    return entries.size();
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_FILECACHE_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
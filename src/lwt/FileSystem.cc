@@ -0,0 +1,440 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+//------------------------------------------------------------------------------
+
+#include "FileSystem.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+//------------------------------------------------------------------------------
+
+using lwt::FileSystem;
+using lwt::IOServer;
+
+//------------------------------------------------------------------------------
+
+class FileSystem::PathOperation : public IOServer::ErrnoOperation
+{
+public:
+    /**
+     * The types of the calls.
+     */
+    typedef enum {
+        /// openat()
+        OPEN,
+        /// fstatat()
+        STAT,
+        /// statx()
+        STATX
+    } type_t;
+
+private:
+    /**
+     * The type of the call.
+     */
+    type_t type;
+
+    /**
+     * The directory file descriptor.
+     */
+    int dirfd;
+
+    /**
+     * The path, which is copied, since the caller may be gone when
+     * the call is performed.
+     */
+    std::string path;
+
+    /**
+     * The flags.
+     */
+    int flags;
+
+    /**
+     * The mode of the file to create, or the mask of statx().
+     */
+    unsigned modeOrMask;
+
+    /**
+     * The result of the call.
+     */
+    int result;
+
+    /**
+     * The status obtained.
+     */
+    union {
+        struct stat st;
+        struct statx stx;
+    } status;
+
+public:
+    /**
+     * Construct the operation.
+     */
+    PathOperation(type_t type, int dirfd, const char* path, int flags,
+                  unsigned modeOrMask = 0);
+
+    /**
+     * Get the result of the call.
+     */
+    int getResult() const;
+
+    /**
+     * Copy the status obtained, if any, into the given output.
+     */
+    void copyStatus(void* output) const;
+
+protected:
+    /**
+     * Perform the call.
+     */
+    virtual void performErrno();
+
+    /**
+     * Close the file descriptor opened, if any, and delete the
+     * operation.
+     */
+    virtual void discard();
+};
+
+//------------------------------------------------------------------------------
+
+FileSystem::PathOperation::PathOperation(type_t type, int dirfd,
+                                         const char* path, int flags,
+                                         unsigned modeOrMask) :
+    type(type),
+    dirfd(dirfd),
+    path(path),
+    flags(flags),
+    modeOrMask(modeOrMask),
+    result(-1)
+{
+    setAbandonable(true);
+}
+
+//------------------------------------------------------------------------------
+
+inline int FileSystem::PathOperation::getResult() const
+{
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+void FileSystem::PathOperation::copyStatus(void* output) const
+{
+    if (result<0) return;
+
+    if (type==STAT) {
+        memcpy(output, &status.st, sizeof(status.st));
+    } else if (type==STATX) {
+        memcpy(output, &status.stx, sizeof(status.stx));
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void FileSystem::PathOperation::performErrno()
+{
+    switch(type) {
+      case OPEN:
+        result = ::openat(dirfd, path.c_str(), flags, modeOrMask);
+        break;
+      case STAT:
+        result = ::fstatat(dirfd, path.c_str(), &status.st, flags);
+        break;
+      case STATX:
+        result = ::statx(dirfd, path.c_str(), flags, modeOrMask,
+                         &status.stx);
+        break;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void FileSystem::PathOperation::discard()
+{
+    if (type==OPEN && result>=0) ::close(result);
+    delete this;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+const size_t FileSystem::BULK_SIZE;
+
+//------------------------------------------------------------------------------
+
+int FileSystem::execute(PathOperation* operation, void* output)
+{
+    // If the execution fails, the operation is discarded by the server
+    if (!IOServer::get().execute(operation)) return -1;
+
+    int result = operation->getResult();
+    int errorNumber = operation->getErrorNumber();
+    if (output!=0) operation->copyStatus(output);
+    delete operation;
+
+    errno = errorNumber;
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::open(const char* path, int flags, mode_t mode)
+{
+    return execute(new PathOperation(PathOperation::OPEN, AT_FDCWD, path,
+                                     flags, mode));
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::openat(int dirfd, const char* path, int flags, mode_t mode)
+{
+    return execute(new PathOperation(PathOperation::OPEN, dirfd, path,
+                                     flags, mode));
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::close(int fd)
+{
+    return IOServer::call(::close, fd);
+}
+
+//------------------------------------------------------------------------------
+
+ssize_t FileSystem::pread(int fd, void* buf, size_t count, off_t offset)
+{
+    return IOServer::callInLane(getLane(count), ::pread,
+                                fd, buf, count, offset);
+}
+
+//------------------------------------------------------------------------------
+
+ssize_t FileSystem::pwrite(int fd, const void* buf, size_t count,
+                           off_t offset)
+{
+    return IOServer::callInLane(getLane(count), ::pwrite,
+                                fd, buf, count, offset);
+}
+
+//------------------------------------------------------------------------------
+
+ssize_t FileSystem::preadv(int fd, const struct iovec* iov, int iovcnt,
+                           off_t offset)
+{
+    return IOServer::callInLane(getLane(getSize(iov, iovcnt)), ::preadv,
+                                fd, iov, iovcnt, offset);
+}
+
+//------------------------------------------------------------------------------
+
+ssize_t FileSystem::pwritev(int fd, const struct iovec* iov, int iovcnt,
+                            off_t offset)
+{
+    return IOServer::callInLane(getLane(getSize(iov, iovcnt)), ::pwritev,
+                                fd, iov, iovcnt, offset);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::stat(const char* path, struct stat* st)
+{
+    return execute(new PathOperation(PathOperation::STAT, AT_FDCWD, path, 0),
+                   st);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::lstat(const char* path, struct stat* st)
+{
+    return execute(new PathOperation(PathOperation::STAT, AT_FDCWD, path,
+                                     AT_SYMLINK_NOFOLLOW),
+                   st);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::fstat(int fd, struct stat* st)
+{
+    return IOServer::call(::fstat, fd, st);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::statx(int dirfd, const char* path, int flags,
+                      unsigned mask, struct statx* stx)
+{
+    return execute(new PathOperation(PathOperation::STATX, dirfd, path,
+                                     flags, mask),
+                   stx);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::fsync(int fd)
+{
+    return IOServer::callInLane(IOServer::BULK, ::fsync, fd);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::fdatasync(int fd)
+{
+    return IOServer::callInLane(IOServer::BULK, ::fdatasync, fd);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::rename(const char* oldPath, const char* newPath)
+{
+    return IOServer::call(::rename, oldPath, newPath);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::unlink(const char* path)
+{
+    return IOServer::call(::unlink, path);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::mkdir(const char* path, mode_t mode)
+{
+    return IOServer::call(::mkdir, path, mode);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::fallocate(int fd, int mode, off_t offset, off_t len)
+{
+    return IOServer::callInLane(IOServer::BULK, ::fallocate,
+                                fd, mode, offset, len);
+}
+
+//------------------------------------------------------------------------------
+
+int FileSystem::ftruncate(int fd, off_t length)
+{
+    return IOServer::call(::ftruncate, fd, length);
+}
+
+//------------------------------------------------------------------------------
+
+bool FileSystem::preadBatch(IORequest* requests, size_t count)
+{
+    size_t size = 0;
+    for(size_t i = 0; i<count; ++i) size += requests[i].count;
+
+    return IOServer::callInLane(getLane(size), [requests, count]() {
+            for(size_t i = 0; i<count; ++i) {
+                IORequest& request = requests[i];
+                request.result = ::pread(request.fd, request.buf,
+                                         request.count, request.offset);
+                request.errorNumber = (request.result<0) ? errno : 0;
+            }
+            return true;
+        });
+}
+
+//------------------------------------------------------------------------------
+
+bool FileSystem::pwriteBatch(IORequest* requests, size_t count)
+{
+    size_t size = 0;
+    for(size_t i = 0; i<count; ++i) size += requests[i].count;
+
+    return IOServer::callInLane(getLane(size), [requests, count]() {
+            for(size_t i = 0; i<count; ++i) {
+                IORequest& request = requests[i];
+                request.result = ::pwrite(request.fd, request.buf,
+                                          request.count, request.offset);
+                request.errorNumber = (request.result<0) ? errno : 0;
+            }
+            return true;
+        });
+}
+
+//------------------------------------------------------------------------------
+
+bool FileSystem::statBatch(StatRequest* requests, size_t count)
+{
+    return IOServer::call([requests, count]() {
+            for(size_t i = 0; i<count; ++i) {
+                StatRequest& request = requests[i];
+                request.result = ::fstatat(request.dirfd, request.path,
+                                           &request.st, request.flags);
+                request.errorNumber = (request.result<0) ? errno : 0;
+            }
+            return true;
+        });
+}
+
+//------------------------------------------------------------------------------
+
+bool FileSystem::fsyncBatch(const int* fds, int* errorNumbers, size_t count)
+{
+    return IOServer::callInLane(IOServer::BULK,
+                                [fds, errorNumbers, count]() {
+            for(size_t i = 0; i<count; ++i) {
+                int result = ::fsync(fds[i]);
+                if (errorNumbers!=0) errorNumbers[i] = (result<0) ? errno : 0;
+            }
+            return true;
+        });
+}
+
+//------------------------------------------------------------------------------
+
+bool FileSystem::closeBatch(const int* fds, int* errorNumbers, size_t count)
+{
+    return IOServer::call([fds, errorNumbers, count]() {
+            for(size_t i = 0; i<count; ++i) {
+                int result = ::close(fds[i]);
+                if (errorNumbers!=0) errorNumbers[i] = (result<0) ? errno : 0;
+            }
+            return true;
+        });
+}
+
+//------------------------------------------------------------------------------
+
+size_t FileSystem::getSize(const struct iovec* iov, int iovcnt)
+{
+    size_t size = 0;
+    for(int i = 0; i<iovcnt; ++i) size += iov[i].iov_len;
+    return size;
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
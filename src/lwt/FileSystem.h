@@ -0,0 +1,303 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+#ifndef LWT_FILESYSTEM_H
+#define LWT_FILESYSTEM_H
+//------------------------------------------------------------------------------
+
+#include "IOServer.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * Wrappers for the blocking file system calls that perform the calls
+ * in the I/O server, so that they do not block the scheduler.
+ *
+ * The functions have the same arguments and return values as the
+ * corresponding system calls, and they set errno the same way. In
+ * addition, they obey the deadline and cancellation of the current
+ * thread like IOServer::execute(), failing with errno set to
+ * ETIMEDOUT or ECANCELED if the call could not be started in time.
+ *
+ * The calls resolving a path (open(), openat(), stat(), lstat() and
+ * statx()) are abandonable, since they may hang, e.g. on an
+ * unresponsive network file system. If the deadline expires while
+ * such a call is running, it fails at once, and its result is
+ * discarded later (a file descriptor opened is closed). The other
+ * calls refer to the caller's buffers, so they are waited for once
+ * started.
+ *
+ * Calls that may take long (fsync(), fdatasync(), fallocate(), and
+ * reads or writes of at least BULK_SIZE bytes) are performed in the
+ * BULK lane, the others in the LATENCY lane.
+ *
+ * The batch variants perform several calls of the same kind in one
+ * handoff to a worker. For a sequence of different calls, such as
+ * opening, reading and closing a file, IOServer::call() can be used
+ * with a lambda.
+ */
+class FileSystem
+{
+public:
+    /**
+     * The number of bytes from which a read or write is performed in
+     * the BULK lane.
+     */
+    static const size_t BULK_SIZE = 1024*1024;
+
+    /**
+     * A request for a read or a write in a batch.
+     */
+    struct IORequest
+    {
+        /// The file descriptor
+        int fd;
+
+        /// The buffer
+        void* buf;
+
+        /// The number of bytes to read or write
+        size_t count;
+
+        /// The offset in the file
+        off_t offset;
+
+        /// The result of the call
+        ssize_t result;
+
+        /// The error number, if the call failed
+        int errorNumber;
+    };
+
+    /**
+     * A request for a stat in a batch. The call is fstatat().
+     */
+    struct StatRequest
+    {
+        /// The directory file descriptor (or AT_FDCWD)
+        int dirfd;
+
+        /// The path
+        const char* path;
+
+        /// The flags (e.g. AT_SYMLINK_NOFOLLOW)
+        int flags;
+
+        /// The status returned
+        struct stat st;
+
+        /// The result of the call
+        int result;
+
+        /// The error number, if the call failed
+        int errorNumber;
+    };
+
+    /**
+     * Open the file with the given path.
+     */
+    static int open(const char* path, int flags, mode_t mode = 0);
+
+    /**
+     * Open the file with the given path relative to the given
+     * directory.
+     */
+    static int openat(int dirfd, const char* path, int flags,
+                      mode_t mode = 0);
+
+    /**
+     * Close the given file descriptor.
+     */
+    static int close(int fd);
+
+    /**
+     * Read from the given offset of the file.
+     */
+    static ssize_t pread(int fd, void* buf, size_t count, off_t offset);
+
+    /**
+     * Write to the given offset of the file.
+     */
+    static ssize_t pwrite(int fd, const void* buf, size_t count,
+                          off_t offset);
+
+    /**
+     * Read into several buffers from the given offset of the file.
+     */
+    static ssize_t preadv(int fd, const struct iovec* iov, int iovcnt,
+                          off_t offset);
+
+    /**
+     * Write from several buffers to the given offset of the file.
+     */
+    static ssize_t pwritev(int fd, const struct iovec* iov, int iovcnt,
+                           off_t offset);
+
+    /**
+     * Get the status of the given file.
+     */
+    static int stat(const char* path, struct stat* st);
+
+    /**
+     * Get the status of the given file, not following a final
+     * symbolic link.
+     */
+    static int lstat(const char* path, struct stat* st);
+
+    /**
+     * Get the status of the given open file.
+     */
+    static int fstat(int fd, struct stat* st);
+
+    /**
+     * Get the extended status of the given file.
+     */
+    static int statx(int dirfd, const char* path, int flags,
+                     unsigned mask, struct statx* stx);
+
+    /**
+     * Synchronize the given file with the storage.
+     */
+    static int fsync(int fd);
+
+    /**
+     * Synchronize the data of the given file with the storage.
+     */
+    static int fdatasync(int fd);
+
+    /**
+     * Rename the given file.
+     */
+    static int rename(const char* oldPath, const char* newPath);
+
+    /**
+     * Remove the given file.
+     */
+    static int unlink(const char* path);
+
+    /**
+     * Create the given directory.
+     */
+    static int mkdir(const char* path, mode_t mode);
+
+    /**
+     * Manipulate the space allocated for the given file.
+     */
+    static int fallocate(int fd, int mode, off_t offset, off_t len);
+
+    /**
+     * Truncate the given file to the given length.
+     */
+    static int ftruncate(int fd, off_t length);
+
+    /**
+     * Perform the given reads in one worker handoff. The result and
+     * the error number of each read are stored in its request.
+     *
+     * @return if the reads could be performed. If not, errno is set
+     * as by IOServer::execute().
+     */
+    static bool preadBatch(IORequest* requests, size_t count);
+
+    /**
+     * Perform the given writes in one worker handoff.
+     *
+     * @see preadBatch()
+     */
+    static bool pwriteBatch(IORequest* requests, size_t count);
+
+    /**
+     * Query the status of the given files in one worker handoff.
+     *
+     * @see preadBatch()
+     */
+    static bool statBatch(StatRequest* requests, size_t count);
+
+    /**
+     * Synchronize the given files with the storage in one worker
+     * handoff.
+     *
+     * @param errorNumbers if not 0, the error number of each fsync()
+     * call is stored in it (0 if successful)
+     *
+     * @see preadBatch()
+     */
+    static bool fsyncBatch(const int* fds, int* errorNumbers, size_t count);
+
+    /**
+     * Close the given file descriptors in one worker handoff.
+     *
+     * @see fsyncBatch()
+     */
+    static bool closeBatch(const int* fds, int* errorNumbers, size_t count);
+
+private:
+    /**
+     * An abandonable operation for a call resolving a path.
+     */
+    class PathOperation;
+
+    /**
+     * Execute the given path operation, which has been allocated by
+     * new, and copy the status obtained, if any, into the given
+     * output.
+     */
+    static int execute(PathOperation* operation, void* output = 0);
+
+    /**
+     * Get the lane for a read or write of the given size.
+     */
+    static IOServer::lane_t getLane(size_t count);
+
+    /**
+     * Get the total size of the given I/O vector.
+     */
+    static size_t getSize(const struct iovec* iov, int iovcnt);
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline IOServer::lane_t FileSystem::getLane(size_t count)
+{
+    return (count>=BULK_SIZE) ? IOServer::BULK : IOServer::LATENCY;
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_FILESYSTEM_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
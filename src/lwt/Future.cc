@@ -0,0 +1,146 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+//------------------------------------------------------------------------------
+
+#include "Future.h"
+
+//------------------------------------------------------------------------------
+
+using lwt::PromiseBase;
+using lwt::FutureBase;
+using lwt::BlockedThread;
+
+//------------------------------------------------------------------------------
+
+PromiseBase::Listener::~Listener()
+{
+    unregister();
+}
+
+//------------------------------------------------------------------------------
+
+void PromiseBase::Listener::unregister()
+{
+    if (source==0) return;
+
+    if (previous==0) {
+        source->firstListener = next;
+    } else {
+        previous->next = next;
+    }
+    if (next!=0) next->previous = previous;
+
+    source = 0;
+    next = previous = 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void PromiseBase::complete(state_t s, int e)
+{
+    assert(state==PENDING && s!=PENDING);
+
+    state = s;
+    error = e;
+
+    while (firstListener!=0) {
+        Listener* listener = firstListener;
+        listener->unregister();
+        listener->handleCompletion(*this);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void PromiseBase::addListener(Listener& listener)
+{
+    assert(!listener.isRegistered());
+
+    if (state!=PENDING) {
+        listener.handleCompletion(*this);
+    } else {
+        listener.source = this;
+        listener.next = firstListener;
+        if (firstListener!=0) firstListener->previous = &listener;
+        firstListener = &listener;
+    }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void FutureBase::startWaiting(BlockedThread& blocker)
+{
+    assert(waiter==0);
+    waiter = &blocker;
+    promise->addListener(*this);
+}
+
+//------------------------------------------------------------------------------
+
+void FutureBase::stopWaiting()
+{
+    unregister();
+    waiter = 0;
+}
+
+//------------------------------------------------------------------------------
+
+bool FutureBase::block(BlockedThread& blocker)
+{
+    BlockedThread::result_t result = blocker.blockCurrent();
+    if (result==BlockedThread::UNBLOCKED) return true;
+
+    errno = (result==BlockedThread::TIMEDOUT) ? ETIMEDOUT : ECANCELED;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+void FutureBase::handleCompletion(PromiseBase& /*promise*/)
+{
+    if (waiter!=0) waiter->unblock();
+}
+
+//------------------------------------------------------------------------------
+
+bool FutureBase::wait()
+{
+    if (!isReady()) {
+        BlockedThread blocker;
+        startWaiting(blocker);
+        bool ok = block(blocker);
+        stopWaiting();
+        if (!ok) return false;
+    }
+
+    if (promise->getState()==PromiseBase::FULFILLED) return true;
+
+    errno = promise->getError();
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,821 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_FUTURE_H
+#define LWT_FUTURE_H
+//------------------------------------------------------------------------------
+
+#include "BlockedThread.h"
+#include "Thread.h"
+
+#include <cerrno>
+#include <new>
+#include <utility>
+
+#include <sys/types.h>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+template <typename T> class PromiseThread;
+
+//------------------------------------------------------------------------------
+
+/**
+ * The type independent part of a promise. It maintains the state of
+ * the promise and an intrusive list of listeners to be notified when
+ * the promise is completed.
+ */
+class PromiseBase
+{
+public:
+    /**
+     * The state of a promise.
+     */
+    typedef enum {
+        /// The promise has not been completed yet
+        PENDING,
+
+        /// The promise has been fulfilled with a value
+        FULFILLED,
+
+        /// The promise has been broken, i.e. no value will come
+        BROKEN
+    } state_t;
+
+    /**
+     * A listener for the completion of a promise. It is embedded into
+     * its owner, so no allocation is needed to register it.
+     */
+    class Listener
+    {
+    private:
+        /**
+         * The promise we are registered with, if any.
+         */
+        PromiseBase* source;
+
+        /**
+         * The next listener of the promise.
+         */
+        Listener* next;
+
+        /**
+         * The previous listener of the promise.
+         */
+        Listener* previous;
+
+    public:
+        /**
+         * Construct the listener.
+         */
+        Listener();
+
+        /**
+         * Copy the listener. The copy is not registered anywhere.
+         */
+        Listener(const Listener& other);
+
+        /**
+         * Destroy the listener by removing it from its promise.
+         */
+        virtual ~Listener();
+
+        /**
+         * Assignment does not touch the registration.
+         */
+        Listener& operator=(const Listener& other);
+
+        /**
+         * Determine if the listener is registered with a promise.
+         */
+        bool isRegistered() const;
+
+        /**
+         * Remove the listener from its promise, if registered.
+         */
+        void unregister();
+
+    protected:
+        /**
+         * Called when the promise is completed. The listener has been
+         * unregistered by then. It is called in the context of the
+         * thread completing the promise, so it should not block.
+         */
+        virtual void handleCompletion(PromiseBase& promise) = 0;
+
+        friend class PromiseBase;
+    };
+
+protected:
+    /**
+     * The state of the promise.
+     */
+    state_t state;
+
+    /**
+     * The error code (an errno value) if the promise is broken.
+     */
+    int error;
+
+    /**
+     * The first listener.
+     */
+    Listener* firstListener;
+
+    /**
+     * Construct the promise in the pending state.
+     */
+    PromiseBase();
+
+    /**
+     * Destroy the promise. If it is still pending, it is broken with
+     * ECANCELED, so that the continuations are called.
+     */
+    ~PromiseBase();
+
+    /**
+     * Complete the promise with the given state and notify the
+     * listeners.
+     */
+    void complete(state_t s, int e = 0);
+
+private:
+    PromiseBase(const PromiseBase&);
+    PromiseBase& operator=(const PromiseBase&);
+
+public:
+    /**
+     * Get the state of the promise.
+     */
+    state_t getState() const;
+
+    /**
+     * Determine if the promise is still pending.
+     */
+    bool isPending() const;
+
+    /**
+     * Get the error code of a broken promise.
+     */
+    int getError() const;
+
+    /**
+     * Break the promise with the given error code. Nothing happens if
+     * the promise is already completed.
+     */
+    void setBroken(int e);
+
+    /**
+     * Add a listener to the promise. If the promise is already
+     * completed, the listener is called immediately.
+     */
+    void addListener(Listener& listener);
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A promise of a value of type T. It is meant to be allocated in
+ * the frame of the thread that needs the value, which then hands a
+ * reference to it to the producer, and gets Future objects from it
+ * to wait for the value. The promise should outlive its futures.
+ */
+template <typename T>
+class Promise : public PromiseBase
+{
+private:
+    /**
+     * The storage of the value.
+     */
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    /**
+     * The thread producing the value, if it is a PromiseThread.
+     */
+    PromiseThread<T>* producer;
+
+public:
+    /**
+     * Construct the promise.
+     */
+    Promise();
+
+    /**
+     * Destroy the promise. If it has a producer thread, that is
+     * cancelled and detached from the promise.
+     */
+    ~Promise();
+
+    /**
+     * Fulfill the promise with the given value. Nothing happens if
+     * the promise is already completed.
+     */
+    void setValue(const T& value);
+
+    /**
+     * Fulfill the promise with the given value. Nothing happens if
+     * the promise is already completed.
+     */
+    void setValue(T&& value);
+
+    /**
+     * Get the value of a fulfilled promise.
+     */
+    T& getValue();
+
+    /**
+     * Get the value of a fulfilled promise.
+     */
+    const T& getValue() const;
+
+    friend class PromiseThread<T>;
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * The type independent part of a future. A future is a handle to a
+ * promise via which threads can wait for the promise to be
+ * completed. It contains a listener, so waiting, also on several
+ * futures at once, does not need any allocation.
+ */
+class FutureBase : public PromiseBase::Listener
+{
+protected:
+    /**
+     * The promise.
+     */
+    PromiseBase* promise;
+
+    /**
+     * The blocked thread reference to unblock when the promise is
+     * completed, if we are being waited for.
+     */
+    BlockedThread* waiter;
+
+    /**
+     * Construct the future for the given promise.
+     */
+    FutureBase(PromiseBase* promise);
+
+    /**
+     * Copy the future. The copy refers to the same promise.
+     */
+    FutureBase(const FutureBase& other);
+
+    /**
+     * Assign the future.
+     */
+    FutureBase& operator=(const FutureBase& other);
+
+    /**
+     * Start waiting via the given blocked thread reference.
+     */
+    void startWaiting(BlockedThread& blocker);
+
+    /**
+     * Stop waiting.
+     */
+    void stopWaiting();
+
+    /**
+     * Block the current thread on the given reference.
+     *
+     * @return if the blocking ended normally. Otherwise errno is
+     * set to ETIMEDOUT or ECANCELED.
+     */
+    static bool block(BlockedThread& blocker);
+
+    /**
+     * Unblock the waiter, if any.
+     */
+    virtual void handleCompletion(PromiseBase& promise);
+
+public:
+    /**
+     * Determine if the future is valid, i.e. refers to a promise.
+     */
+    bool isValid() const;
+
+    /**
+     * Determine if the promise is completed.
+     */
+    bool isReady() const;
+
+    /**
+     * Get the state of the promise.
+     */
+    PromiseBase::state_t getState() const;
+
+    /**
+     * Get the error code of the promise, if it is broken.
+     */
+    int getError() const;
+
+    /**
+     * Wait for the promise to be completed.
+     *
+     * @return if the promise has been fulfilled. If not, errno is set
+     * to the error code of the broken promise, or to ETIMEDOUT or
+     * ECANCELED if the waiting has timed out or been cancelled.
+     */
+    bool wait();
+
+    /**
+     * Add a continuation to be called when the promise is completed.
+     */
+    void then(PromiseBase::Listener& continuation);
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A future of a value of type T.
+ */
+template <typename T>
+class Future : public FutureBase
+{
+public:
+    /**
+     * Wait for any of the given futures to be completed.
+     *
+     * @return the index of a completed future, or -1 if the waiting
+     * has timed out or been cancelled (errno is set accordingly).
+     */
+    static ssize_t waitAny(Future* futures, size_t count);
+
+    /**
+     * Wait for all the given futures to be completed.
+     *
+     * @return if all the futures have been fulfilled. If not, errno
+     * is set as by wait().
+     */
+    static bool waitAll(Future* futures, size_t count);
+
+    /**
+     * Construct an invalid future.
+     */
+    Future();
+
+    /**
+     * Construct a future for the given promise.
+     */
+    Future(Promise<T>& promise);
+
+    /**
+     * Get the value of the fulfilled promise.
+     */
+    T& get() const;
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A continuation calling a function object with the completed
+ * promise as its argument.
+ */
+template <typename T, typename F>
+class Continuation : public PromiseBase::Listener
+{
+private:
+    /**
+     * The function object.
+     */
+    F function;
+
+public:
+    /**
+     * Construct the continuation.
+     */
+    Continuation(F function);
+
+protected:
+    /**
+     * Call the function.
+     */
+    virtual void handleCompletion(PromiseBase& promise);
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A detached thread producing the value of a promise. This is the
+ * replacement of joining a thread with a result: the thread sets the
+ * value via setResult(), and the spawning thread waits for the future
+ * of the promise. If the thread finishes without setting the result,
+ * the promise is broken with ECANCELED. If the promise is destroyed
+ * before the thread finishes, the thread is cancelled.
+ */
+template <typename T>
+class PromiseThread : public Thread
+{
+private:
+    /**
+     * The promise, or 0 if it has been destroyed.
+     */
+    Promise<T>* promise;
+
+protected:
+    /**
+     * Construct the thread for the given promise.
+     */
+    PromiseThread(Promise<T>& promise);
+
+    /**
+     * Destroy the thread. The promise is broken, if still pending.
+     */
+    virtual ~PromiseThread();
+
+    /**
+     * Determine if the result is still needed.
+     */
+    bool isNeeded() const;
+
+    /**
+     * Set the result.
+     */
+    void setResult(const T& value);
+
+    /**
+     * Set the result.
+     */
+    void setResult(T&& value);
+
+    /**
+     * Set an error code as the result.
+     */
+    void setError(int e);
+
+    friend class Promise<T>;
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline PromiseBase::Listener::Listener() :
+    source(0),
+    next(0),
+    previous(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline PromiseBase::Listener::Listener(const Listener& /*other*/) :
+    source(0),
+    next(0),
+    previous(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline PromiseBase::Listener&
+PromiseBase::Listener::operator=(const Listener& /*other*/)
+{
+    return *this;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool PromiseBase::Listener::isRegistered() const
+{
+    return source!=0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline PromiseBase::PromiseBase() :
+    state(PENDING),
+    error(0),
+    firstListener(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline PromiseBase::~PromiseBase()
+{
+    if (state==PENDING) complete(BROKEN, ECANCELED);
+}
+
+//------------------------------------------------------------------------------
+
+inline PromiseBase::state_t PromiseBase::getState() const
+{
+    return state;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool PromiseBase::isPending() const
+{
+    return state==PENDING;
+}
+
+//------------------------------------------------------------------------------
+
+inline int PromiseBase::getError() const
+{
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
+inline void PromiseBase::setBroken(int e)
+{
+    if (state==PENDING) complete(BROKEN, e);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline Promise<T>::Promise() :
+    producer(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline Promise<T>::~Promise()
+{
+    if (producer!=0) {
+        producer->promise = 0;
+        producer->cancel();
+    }
+    if (state==PENDING) {
+        complete(BROKEN, ECANCELED);
+    } else if (state==FULFILLED) {
+        getValue().~T();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline void Promise<T>::setValue(const T& value)
+{
+    if (state!=PENDING) return;
+    new (storage) T(value);
+    complete(FULFILLED);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline void Promise<T>::setValue(T&& value)
+{
+    if (state!=PENDING) return;
+    new (storage) T(std::move(value));
+    complete(FULFILLED);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline T& Promise<T>::getValue()
+{
+    assert(state==FULFILLED);
+    return *reinterpret_cast<T*>(storage);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline const T& Promise<T>::getValue() const
+{
+    assert(state==FULFILLED);
+    return *reinterpret_cast<const T*>(storage);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline FutureBase::FutureBase(PromiseBase* promise) :
+    promise(promise),
+    waiter(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline FutureBase::FutureBase(const FutureBase& other) :
+    PromiseBase::Listener(other),
+    promise(other.promise),
+    waiter(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline FutureBase& FutureBase::operator=(const FutureBase& other)
+{
+    assert(waiter==0);
+    promise = other.promise;
+    return *this;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool FutureBase::isValid() const
+{
+    return promise!=0;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool FutureBase::isReady() const
+{
+    return promise->getState()!=PromiseBase::PENDING;
+}
+
+//------------------------------------------------------------------------------
+
+inline PromiseBase::state_t FutureBase::getState() const
+{
+    return promise->getState();
+}
+
+//------------------------------------------------------------------------------
+
+inline int FutureBase::getError() const
+{
+    return promise->getError();
+}
+
+//------------------------------------------------------------------------------
+
+inline void FutureBase::then(PromiseBase::Listener& continuation)
+{
+    promise->addListener(continuation);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <typename T>
+ssize_t Future<T>::waitAny(Future* futures, size_t count)
+{
+    for(size_t i = 0; i<count; ++i) {
+        if (futures[i].isReady()) return i;
+    }
+
+    BlockedThread blocker;
+    for(size_t i = 0; i<count; ++i) {
+        futures[i].startWaiting(blocker);
+    }
+    bool ok = block(blocker);
+    for(size_t i = 0; i<count; ++i) {
+        futures[i].stopWaiting();
+    }
+    if (!ok) return -1;
+
+    for(size_t i = 0; i<count; ++i) {
+        if (futures[i].isReady()) return i;
+    }
+    assert(0);
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+bool Future<T>::waitAll(Future* futures, size_t count)
+{
+    for(size_t i = 0; i<count; ++i) {
+        if (!futures[i].wait()) return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline Future<T>::Future() :
+    FutureBase(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline Future<T>::Future(Promise<T>& promise) :
+    FutureBase(&promise)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline T& Future<T>::get() const
+{
+    return static_cast<Promise<T>*>(promise)->getValue();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <typename T, typename F>
+inline Continuation<T, F>::Continuation(F function) :
+    function(function)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T, typename F>
+void Continuation<T, F>::handleCompletion(PromiseBase& promise)
+{
+    function(static_cast<Promise<T>&>(promise));
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline PromiseThread<T>::PromiseThread(Promise<T>& promise) :
+    Thread(false),
+    promise(&promise)
+{
+    assert(promise.producer==0);
+    promise.producer = this;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+PromiseThread<T>::~PromiseThread()
+{
+    if (promise!=0) {
+        promise->producer = 0;
+        promise->setBroken(ECANCELED);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline bool PromiseThread<T>::isNeeded() const
+{
+    return promise!=0 && promise->isPending();
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline void PromiseThread<T>::setResult(const T& value)
+{
+    if (promise!=0) promise->setValue(value);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline void PromiseThread<T>::setResult(T&& value)
+{
+    if (promise!=0) promise->setValue(std::move(value));
+}
+
+//------------------------------------------------------------------------------
+
+template <typename T>
+inline void PromiseThread<T>::setError(int e)
+{
+    if (promise!=0) promise->setBroken(e);
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_FUTURE_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -20,215 +20,386 @@
 
 #include "IOServer.h"
 
-#include "ThreadedFD.h"
+#include "BlockedThread.h"
+#include "PolledFD.h"
 #include "EPoll.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
+#include <string>
 
-#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 //------------------------------------------------------------------------------
 
 using lwt::IOServer;
+using lwt::BlockedThread;
+using lwt::PolledFD;
+using lwt::Thread;
 
 //------------------------------------------------------------------------------
 
-class IOServer::Worker
+class IOServer::CompletionFD : public PolledFD
 {
 private:
     /**
-     * Create a pipe.
-     *
-     * @param returnWriting if true, the writing end will be returned,
-     * otherwise the reading end
-     * @param otherEnd will contain the other end of the pipe, than
-     * what is returned
+     * The server.
      */
-    static int createPipe(bool returnWriting, int& otherEnd);
+    IOServer& server;
 
+public:
     /**
-     * The start routine for the thread.
+     * Construct the file descriptor.
      */
-    static void* startThread(void* arg);
+    CompletionFD(IOServer& server);
 
     /**
-     * The POSIX thread running this worker.
+     * Signal that there are completed operations. It can be called
+     * from any thread.
      */
-    pthread_t thread;
+    void signal();
 
     /**
-     * The writing end of the pipe through which operations are sent to
-     * this worker.
+     * Clear the signal.
      */
-    ThreadedFD* toWorker;
+    void clear();
 
+protected:
     /**
-     * The reading end of the pipe via which results are received from
-     * this worker.
+     * Drain the completed operations.
      */
-    ThreadedFD* fromWorker;
+    virtual void handleEvents(uint32_t events);
 
     /**
-     * The reading end of the pipe through which operations are
-     * received from the clients.
+     * The file descriptor remains registered for EPOLLIN all the
+     * time to avoid an epoll_ctl() call per operation, but the event
+     * is reported only if there are operations outstanding, so that
+     * the scheduler quits only if there is nothing to wait for.
      */
-    int fromClient;
+    virtual int updateEvents(uint32_t& events);
+};
 
-    /**
-     * The writing end of the pipe through which results are
-     * sent to the clients.
-     */
-    int toClient;
+//------------------------------------------------------------------------------
 
-public:
-    /**
-     * Construct the worker. It starts the thread.
-     */
-    Worker();
+IOServer::CompletionFD::CompletionFD(IOServer& server) :
+    PolledFD(eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC), EPOLLIN),
+    server(server)
+{
+}
 
-    /**
-     * Destroy the worker. It joins the thread.
-     */
-    ~Worker();
+//------------------------------------------------------------------------------
 
-    /**
-     * Start the given operation on the worker. This one writes
-     * pointer to the thread.
-     *
-     * @return if the pointer could be written
-     */
-    bool start(Operation* operation);
+inline void IOServer::CompletionFD::signal()
+{
+    uint64_t value = 1;
+    ::write(fd, &value, sizeof(value));
+}
 
-    /**
-     * Wait the result of the last operation sent.
-     *
-     * @return the operation pointer read, or 0 on error.
-     */
-    Operation* waitResult();
+//------------------------------------------------------------------------------
 
-    /**
-     * Execute the given operation. This is a combination of start and
-     * waitResult.
-     *
-     * @return if the operation could be written and executed.
-     */
-    bool execute(Operation* operation);
+inline void IOServer::CompletionFD::clear()
+{
+    uint64_t value = 0;
+    ::read(fd, &value, sizeof(value));
+}
 
-private:
-    /**
-     * Perform the actual operation of the thread.
-     */
-    void run();
-};
+//------------------------------------------------------------------------------
+
+void IOServer::CompletionFD::handleEvents(uint32_t /*events*/)
+{
+    server.drainCompleted();
+}
 
 //------------------------------------------------------------------------------
 
-int IOServer::Worker::createPipe(bool returnWriting, int& otherEnd)
+int IOServer::CompletionFD::updateEvents(uint32_t& events)
 {
-    int fds[2];
-    if (pipe(fds)<0) {
-        otherEnd = -1;
-        return -1;
-    } else {
-        otherEnd = fds[returnWriting ? 0 : 1];
-        return fds[returnWriting ? 1 : 0];
-    }
+    uint32_t registeredEvents = 0;
+    int result = PolledFD::updateEvents(registeredEvents);
+    if (server.numOutstanding>0) events |= registeredEvents;
+    return result;
 }
 
+//------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-void* IOServer::Worker::startThread(void* arg)
+void IOServer::ErrnoOperation::perform()
 {
-    Worker* worker = reinterpret_cast<Worker*>(arg);
-    worker->run();
-    return 0;
+    performErrno();
+    errorNumber = errno;
 }
 
+//------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-IOServer::Worker::Worker() :
-    toWorker(new ThreadedFD(createPipe(true, fromClient))),
-    fromWorker(new ThreadedFD(createPipe(false, toClient)))
+inline IOServer::Queue::Queue() :
+    first(0),
+    last(0),
+    length(0)
 {
-    pthread_create(&thread, 0, &startThread, this);
 }
 
 //------------------------------------------------------------------------------
 
-IOServer::Worker::~Worker()
+inline bool IOServer::Queue::empty() const
 {
-    toWorker->close();
-    EPoll::get().destroy(toWorker);
-    EPoll::get().destroy(fromWorker);
-    pthread_join(thread, 0);
+    return first==0;
 }
 
 //------------------------------------------------------------------------------
 
-inline bool IOServer::Worker::start(Operation* operation)
+inline size_t IOServer::Queue::size() const
 {
-    return toWorker->writeAll(&operation, sizeof(operation));
+    return length;
 }
 
 //------------------------------------------------------------------------------
 
-inline IOServer::Operation* IOServer::Worker::waitResult()
+inline IOServer::Operation* IOServer::Queue::front() const
 {
-    Operation* operation = 0;
-    if (fromWorker->read(&operation, sizeof(operation))!=sizeof(operation)) {
-        operation = 0;
+    return first;
+}
+
+//------------------------------------------------------------------------------
+
+inline void IOServer::Queue::push(Operation* operation)
+{
+    operation->next = 0;
+    if (last==0) {
+        first = operation;
+    } else {
+        last->next = operation;
     }
+    last = operation;
+    ++length;
+}
+
+//------------------------------------------------------------------------------
+
+inline IOServer::Operation* IOServer::Queue::pop()
+{
+    Operation* operation = first;
+    first = operation->next;
+    if (first==0) last = 0;
+    operation->next = 0;
+    --length;
     return operation;
 }
 
 //------------------------------------------------------------------------------
 
-bool IOServer::Worker::execute(Operation* operation)
+void IOServer::Queue::remove(Operation* operation)
 {
-    if (!start(operation)) return false;
+    Operation* previous = 0;
+    Operation* o = first;
+    while (o!=operation) {
+        previous = o;
+        o = o->next;
+    }
 
-    Operation* result = waitResult();
-    assert(result==operation);
-    return operation==result;
+    if (previous==0) {
+        first = operation->next;
+    } else {
+        previous->next = operation->next;
+    }
+    if (last==operation) last = previous;
+    operation->next = 0;
+    --length;
 }
 
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+const nanos_t IOServer::DEFAULT_GROW_THRESHOLD;
+
+//------------------------------------------------------------------------------
+
+const nanos_t IOServer::DEFAULT_IDLE_TIMEOUT;
+
 //------------------------------------------------------------------------------
 
-void IOServer::Worker::run()
+const size_t IOServer::DEFAULT_WORKERS_PER_CPU;
+
+//------------------------------------------------------------------------------
+
+IOServer* IOServer::instance = 0;
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+/**
+ * Get the path of the cgroup of the process from /proc/self/cgroup
+ * in the cgroup v1 hierarchy with the given controller, or in the
+ * cgroup v2 hierarchy, if the controller is empty.
+ *
+ * @return if the path has been found
+ */
+bool getCGroupPath(const std::string& controller, std::string& path)
 {
-    Operation* operation = 0;
-    while(read(fromClient, &operation, sizeof(operation))==sizeof(operation)) {
-        operation->perform();
-        if (write(toClient, &operation, sizeof(operation))<0) {
-            break;
+    FILE* f = fopen("/proc/self/cgroup", "r");
+    if (f==0) return false;
+
+    // Each line is hierarchy-ID:controller-list:cgroup-path
+    bool found = false;
+    char line[4096];
+    while (!found && fgets(line, sizeof(line), f)!=0) {
+        char* controllers = strchr(line, ':');
+        if (controllers==0) continue;
+        ++controllers;
+        char* cgroupPath = strchr(controllers, ':');
+        if (cgroupPath==0) continue;
+        *cgroupPath++ = 0;
+        cgroupPath[strcspn(cgroupPath, "\n")] = 0;
+
+        if (controller.empty()) {
+            found = strncmp(line, "0:", 2)==0 && *controllers==0;
+        } else {
+            std::string list = std::string(",") + controllers + ",";
+            found = list.find("," + controller + ",")!=std::string::npos;
         }
+        if (found) path = cgroupPath;
     }
+
+    fclose(f);
+    return found;
 }
 
-//------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-void IOServer::ErrnoOperation::perform()
+/**
+ * Open the file with the given name of the cgroup of the process
+ * in the hierarchy mounted at the given directory. If the file is
+ * not found in the directory of the cgroup, e.g. because only the
+ * cgroup of the process is mounted in a container, the one at the
+ * root of the mount is opened.
+ */
+FILE* openCGroupFile(const std::string& mount, const std::string& path,
+                     const char* name)
 {
-    performErrno();
-    errorNumber = errno;
+    if (path=="/") return fopen((mount + "/" + name).c_str(), "r");
+
+    FILE* f = fopen((mount + path + "/" + name).c_str(), "r");
+    if (f==0) f = fopen((mount + "/" + name).c_str(), "r");
+    return f;
 }
 
+//------------------------------------------------------------------------------
+
+} /* anonymous namespace */
+
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-IOServer* IOServer::instance = 0;
+size_t IOServer::getCPULimit()
+{
+    size_t numCPUs = 0;
+
+    cpu_set_t cpuSet;
+    if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet)==0) {
+        numCPUs = CPU_COUNT(&cpuSet);
+    } else {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n>0) numCPUs = n;
+    }
+
+    // The quota and the period of the cgroup of the process in
+    // cgroup v2, or those in cgroup v1
+    unsigned long long quota = 0, period = 0;
+    std::string path;
+    FILE* f = 0;
+    if (getCGroupPath("", path) &&
+        (f = openCGroupFile("/sys/fs/cgroup", path, "cpu.max"))!=0)
+    {
+        char quotaStr[32];
+        if (fscanf(f, "%31s %llu", quotaStr, &period)==2 &&
+            strcmp(quotaStr, "max")!=0)
+        {
+            quota = strtoull(quotaStr, 0, 10);
+        }
+        fclose(f);
+    } else if (getCGroupPath("cpu", path) &&
+               (f = openCGroupFile("/sys/fs/cgroup/cpu", path,
+                                   "cpu.cfs_quota_us"))!=0)
+    {
+        long long q = -1;
+        if (fscanf(f, "%lld", &q)==1 && q>0) quota = q;
+        fclose(f);
+
+        if (quota>0 &&
+            (f = openCGroupFile("/sys/fs/cgroup/cpu", path,
+                                "cpu.cfs_period_us"))!=0)
+        {
+            if (fscanf(f, "%llu", &period)!=1) period = 0;
+            fclose(f);
+        }
+    }
+
+    if (quota>0 && period>0) {
+        size_t quotaCPUs = (quota + period - 1) / period;
+        if (numCPUs==0 || quotaCPUs<numCPUs) numCPUs = quotaCPUs;
+    }
+
+    return std::max(numCPUs, static_cast<size_t>(1));
+}
+
+//------------------------------------------------------------------------------
+
+void* IOServer::startWorker(void* arg)
+{
+    IOServer* server = reinterpret_cast<IOServer*>(arg);
+    server->runWorker();
+    return 0;
+}
 
 //------------------------------------------------------------------------------
 
 IOServer::IOServer(size_t numWorkers) :
-    workers(new Worker[numWorkers])
+    IOServer(numWorkers, numWorkers)
+{
+}
+
+//------------------------------------------------------------------------------
+
+IOServer::IOServer(size_t minWorkers, size_t maxWorkers,
+                   nanos_t growThreshold, nanos_t idleTimeout,
+                   size_t latencyReserve) :
+    numQueued(0),
+    numIdle(0),
+    stopping(false),
+    minWorkers(minWorkers),
+    maxWorkers(std::max(minWorkers, maxWorkers)),
+    growThreshold(growThreshold),
+    idleTimeout(idleTimeout),
+    numWorkers(0),
+    growing(false),
+    maxRunningBulk(1),
+    numRunningBulk(0),
+    completed(0),
+    completionFD(new CompletionFD(*this)),
+    numOutstanding(0)
 {
-    availableWorkers.reserve(numWorkers);
-    for(size_t i = 0; i<numWorkers; ++i) {
-        availableWorkers.push_back(workers+i);
+    if (this->maxWorkers>latencyReserve) {
+        maxRunningBulk = this->maxWorkers - latencyReserve;
     }
-    instance = this;
+    init();
+}
+
+//------------------------------------------------------------------------------
+
+IOServer::IOServer() :
+    IOServer(1, DEFAULT_WORKERS_PER_CPU * getCPULimit())
+{
 }
 
 //------------------------------------------------------------------------------
@@ -236,67 +407,410 @@ IOServer::IOServer(size_t numWorkers) :
 IOServer::~IOServer()
 {
     instance = 0;
-    delete [] workers;
+    stop();
+    EPoll::get().destroy(completionFD);
+    pthread_cond_destroy(&condition);
+    pthread_mutex_destroy(&mutex);
+}
+
+//------------------------------------------------------------------------------
+
+bool IOServer::Operation::wait()
+{
+    return IOServer::get().wait(this);
+}
+
+//------------------------------------------------------------------------------
+
+bool IOServer::Operation::cancel()
+{
+    return IOServer::get().cancel(this);
 }
 
 //------------------------------------------------------------------------------
 
-bool IOServer::execute(Operation* operation, bool canBlock)
+void IOServer::Operation::abandon()
 {
-    bool result = false;
+    IOServer::get().abandon(this);
+}
 
-    Worker* worker = getWorker(canBlock);
-    if (worker!=0) {
-        result = worker->execute(operation);
-        putWorker(worker);
+//------------------------------------------------------------------------------
+
+void IOServer::Operation::discard()
+{
+    delete this;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool IOServer::wait(Operation* operation)
+{
+    if (operation->getState()==Operation::IDLE) {
+        errno = EINVAL;
+        return false;
     }
 
-    return result;
+    assert(operation->waiter==0);
+
+    BlockedThread waiter;
+    operation->waiter = &waiter;
+    while (operation->isPending()) {
+        BlockedThread::result_t result = waiter.blockCurrent();
+        if (result!=BlockedThread::UNBLOCKED && operation->isPending()) {
+            int errorNumber = (result==BlockedThread::TIMEDOUT) ?
+                ETIMEDOUT : ECANCELED;
+            if (dequeue(operation)) {
+                operation->waiter = 0;
+                if (operation->abandonable) operation->discard();
+                errno = errorNumber;
+                return false;
+            } else if (operation->abandonable) {
+                // It is still running, so it is discarded when
+                // drained from the completion stack
+                operation->waiter = 0;
+                operation->abandoned = true;
+                errno = errorNumber;
+                return false;
+            }
+
+            Thread::UninterruptibleScope uninterruptibleScope;
+            while (operation->isPending()) {
+                waiter.blockCurrent();
+            }
+        }
+    }
+    operation->waiter = 0;
+
+    // Cancelled by cancel() while queued, before or during the waiting
+    if (operation->getState()==Operation::CANCELLED) {
+        if (operation->abandonable) operation->discard();
+        errno = ECANCELED;
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool IOServer::cancel(Operation* operation)
+{
+    if (!dequeue(operation)) {
+        errno = operation->isPending() ? EBUSY : EINVAL;
+        return false;
+    }
+
+    operation->state.store(Operation::CANCELLED, std::memory_order_release);
+    if (operation->waiter!=0) operation->waiter->unblock();
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+void IOServer::abandon(Operation* operation)
+{
+    assert(operation->waiter==0);
+
+    if (dequeue(operation) || !operation->isPending()) {
+        operation->discard();
+    } else {
+        operation->abandoned = true;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+size_t IOServer::getNumWorkers()
+{
+    pthread_mutex_lock(&mutex);
+    size_t n = numWorkers;
+    pthread_mutex_unlock(&mutex);
+    return n;
 }
 
 //------------------------------------------------------------------------------
 
 void IOServer::stop()
 {
-    delete [] workers;
-    workers = 0;
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&condition);
+    while (numWorkers>0) {
+        pthread_cond_wait(&condition, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    drainCompleted();
+}
+
+//------------------------------------------------------------------------------
+
+void IOServer::init()
+{
+    pthread_mutex_init(&mutex, 0);
+
+    // The idle timeout is measured on the monotonic clock
+    pthread_condattr_t conditionAttr;
+    pthread_condattr_init(&conditionAttr);
+    pthread_condattr_setclock(&conditionAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&condition, &conditionAttr);
+    pthread_condattr_destroy(&conditionAttr);
+
+    pthread_mutex_lock(&mutex);
+    for(size_t i = 0; i<minWorkers; ++i) {
+        addWorker();
+    }
+    growing = false;
+    pthread_mutex_unlock(&mutex);
+
+    instance = this;
+}
+
+//------------------------------------------------------------------------------
+
+bool IOServer::addWorker()
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    bool started = pthread_create(&thread, &attr, &startWorker, this)==0;
+    pthread_attr_destroy(&attr);
+
+    if (started) {
+        ++numWorkers;
+        growing = true;
+    }
+    return started;
+}
 
-    availableWorkers.clear();
+//------------------------------------------------------------------------------
 
-    for(std::deque<BlockedThread*>::iterator i = waiters.begin();
-        i!=waiters.end(); ++i)
+inline void IOServer::grow(nanos_t waitTime)
+{
+    if (waitTime>=growThreshold && !growing && !stopping &&
+        numWorkers<maxWorkers)
     {
-        BlockedThread* blockedThread = *i;
-        delete blockedThread;
+        addWorker();
     }
-    waiters.clear();
 }
 
 //------------------------------------------------------------------------------
 
-IOServer::Worker* IOServer::getWorker(bool canBlock)
+void IOServer::runWorker()
 {
-    while(availableWorkers.empty()) {
-        if (!canBlock || workers==0) return 0;
-        BlockedThread* blockedThread = new BlockedThread;
-        waiters.push_back(blockedThread);
-        blockedThread->blockCurrent();
+    pthread_mutex_lock(&mutex);
+    growing = false;
+    pthread_mutex_unlock(&mutex);
+
+    // The operation may be gone once completed, so its lane is
+    // remembered beforehand
+    bool bulk = false;
+    Operation* operation = 0;
+    while((operation = take(bulk))!=0) {
+        bulk = operation->lane==BULK;
+        operation->perform();
+        complete(operation);
     }
+}
 
-    Worker* worker = availableWorkers.back();
-    availableWorkers.pop_back();
-    return worker;
+//------------------------------------------------------------------------------
+
+bool IOServer::submit(Operation* operation, bool canBlock)
+{
+    assert(!operation->isPending());
+
+    lane_t lane = operation->lane;
+    Queue& queue = queues[lane];
+
+    pthread_mutex_lock(&mutex);
+
+    if (stopping || maxWorkers==0) {
+        pthread_mutex_unlock(&mutex);
+        errno = ECANCELED;
+        return false;
+    }
+
+    // The idle workers take the LATENCY operations first
+    size_t numAhead = (lane==LATENCY) ?
+        queues[LATENCY].size() : numQueued;
+    bool canTake = lane==LATENCY || numRunningBulk<maxRunningBulk;
+
+    if (!canBlock && (!canTake || numIdle<=numAhead)) {
+        pthread_mutex_unlock(&mutex);
+        errno = EAGAIN;
+        return false;
+    }
+
+    nanos_t now = currentTimeNanos();
+
+    operation->state.store(Operation::QUEUED, std::memory_order_release);
+    operation->submitTime = now;
+    queue.push(operation);
+    ++numQueued;
+    bool wakeWorker = canTake && numIdle>0;
+
+    if (numWorkers==0) {
+        addWorker();
+    } else if (numIdle<=numAhead) {
+        if (lane==LATENCY && numRunningBulk>=numWorkers &&
+            numWorkers<maxWorkers)
+        {
+            // All workers are busy with BULK operations, which cannot
+            // be waited for
+            addWorker();
+        } else if (canTake) {
+            grow(now - queue.front()->submitTime);
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    // Signalling after unlocking, so that the worker woken up does
+    // not block on the mutex immediately
+    if (wakeWorker) pthread_cond_signal(&condition);
+
+    ++numOutstanding;
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool IOServer::dequeue(Operation* operation)
+{
+    bool removed = false;
+
+    pthread_mutex_lock(&mutex);
+    if (operation->getState()==Operation::QUEUED) {
+        queues[operation->lane].remove(operation);
+        --numQueued;
+
+        operation->state.store(Operation::IDLE, std::memory_order_release);
+        removed = true;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (removed) --numOutstanding;
+
+    return removed;
+}
+
+//------------------------------------------------------------------------------
+
+inline IOServer::Queue* IOServer::getTakeableQueue()
+{
+    if (!queues[LATENCY].empty()) {
+        return &queues[LATENCY];
+    } else if (!queues[BULK].empty() && numRunningBulk<maxRunningBulk) {
+        return &queues[BULK];
+    } else {
+        return 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+IOServer::Operation* IOServer::take(bool finishedBulk)
+{
+    pthread_mutex_lock(&mutex);
+
+    if (finishedBulk) --numRunningBulk;
+
+    struct timespec idleDeadline;
+    clock_gettime(CLOCK_MONOTONIC, &idleDeadline);
+    idleDeadline.tv_sec += idleTimeout / 1000000000;
+    idleDeadline.tv_nsec += idleTimeout % 1000000000;
+    if (idleDeadline.tv_nsec>=1000000000) {
+        idleDeadline.tv_nsec -= 1000000000;
+        ++idleDeadline.tv_sec;
+    }
+
+    Queue* queue = 0;
+    while ((queue = getTakeableQueue())==0 && !stopping) {
+        ++numIdle;
+        int result = (numWorkers>minWorkers) ?
+            pthread_cond_timedwait(&condition, &mutex, &idleDeadline) :
+            pthread_cond_wait(&condition, &mutex);
+        --numIdle;
+        if (result==ETIMEDOUT && numWorkers>minWorkers &&
+            (queue = getTakeableQueue())==0)
+        {
+            break;
+        }
+    }
+
+    Operation* operation = 0;
+    if (queue!=0) {
+        operation = queue->pop();
+        --numQueued;
+        operation->state.store(Operation::RUNNING, std::memory_order_release);
+        if (operation->lane==BULK) ++numRunningBulk;
+
+        // If the operation has waited for long, and there are more
+        // behind it, the pool may be too small
+        if (!queue->empty()) {
+            grow(currentTimeNanos() - operation->submitTime);
+        }
+    } else {
+        --numWorkers;
+        // Let stop() know
+        if (stopping) pthread_cond_broadcast(&condition);
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return operation;
+}
+
+//------------------------------------------------------------------------------
+
+void IOServer::complete(Operation* operation)
+{
+    Operation* top = completed.load(std::memory_order_relaxed);
+    do {
+        operation->next = top;
+    } while (!completed.compare_exchange_weak(top, operation,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+
+    // Only the first completion after a drain needs a wakeup
+    if (top==0) completionFD->signal();
 }
 
 //------------------------------------------------------------------------------
 
-void IOServer::putWorker(Worker* worker)
+void IOServer::drainCompleted()
 {
-    availableWorkers.push_back(worker);
-    if (!waiters.empty()) {
-        BlockedThread* blockedThread = waiters.front();
-        waiters.pop_front();
-        delete blockedThread;
+    completionFD->clear();
+
+    Operation* operation = completed.exchange(0, std::memory_order_acquire);
+
+    // Reverse the stack, so that the operations are completed in order
+    Operation* first = 0;
+    while (operation!=0) {
+        Operation* next = operation->next;
+        operation->next = first;
+        first = operation;
+        operation = next;
+    }
+
+    while (first!=0) {
+        operation = first;
+        first = operation->next;
+
+        operation->next = 0;
+        operation->state.store(Operation::COMPLETED,
+                               std::memory_order_release);
+        --numOutstanding;
+        if (operation->abandoned) {
+            operation->discard();
+        } else if (operation->waiter!=0) {
+            operation->waiter->unblock();
+        }
     }
 }
 
@@ -307,4 +821,3 @@ void IOServer::putWorker(Worker* worker)
 // c-basic-offset: 4
 // indent-tabs-mode: nil
 // End:
-
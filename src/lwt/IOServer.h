@@ -20,10 +20,17 @@
 #define LWT_IOSERVER_H
 //------------------------------------------------------------------------------
 
+#include "util.h"
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
 #include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
 
-#include <vector>
-#include <deque>
+#include <pthread.h>
 
 //------------------------------------------------------------------------------
 
@@ -37,27 +44,241 @@ class BlockedThread;
 
 /**
  * An I/O server that can be used to perform blocking operations.
+ *
+ * The operations are put into a submission queue shared by all
+ * worker threads. A worker takes the first operation from the queue,
+ * performs it, and pushes it onto a lock-free completion stack. An
+ * eventfd notifies the scheduler when the stack is no longer empty,
+ * and the scheduler then drains all completed operations at once,
+ * unblocking the threads waiting for them.
+ *
+ * The number of workers is kept between a minimum and a maximum. If
+ * an operation has been waiting in the queue for longer than a
+ * threshold when a new operation is submitted or a worker takes
+ * one, a new worker is started. Only one worker is started at a
+ * time, so the pool grows gradually. A worker above the minimum
+ * exits if it has been idle for a certain time.
+ *
+ * Each operation belongs to a lane. There is a separate queue for
+ * each lane, and the workers always take from the LATENCY queue
+ * first. Furthermore, a number of workers are reserved for the
+ * LATENCY lane: BULK operations can occupy at most the maximal number
+ * of workers minus the reserve. If a LATENCY operation is submitted
+ * while all workers are busy with BULK operations, a new worker is
+ * started immediately, so such operations never wait behind BULK
+ * ones.
+ *
+ * A queued operation can be cancelled, and it is removed from the
+ * queue if the deadline of the waiting thread expires. A running
+ * operation cannot be interrupted, but an operation allocated on the
+ * heap can be made abandonable: then the waiting thread gives up on
+ * it just like on a queued one, and the operation is discarded when
+ * the worker finishes it. This way a hanging system call (e.g. a stat
+ * on an unresponsive network file system) keeps only a worker busy,
+ * but not the thread waiting for it.
  */
 class IOServer
 {
 public:
     /**
-     * Base class for the operations to perform.
+     * The lanes of the operations.
+     */
+    typedef enum {
+        /// Short operations a thread is usually waiting for
+        /// interactively, such as stat() or open()
+        LATENCY = 0,
+
+        /// Operations that may take long, such as fsync() or reading
+        /// a large directory
+        BULK,
+
+        /// The number of lanes
+        NUM_LANES
+    } lane_t;
+
+    /**
+     * Base class for the operations to perform. An operation can be
+     * executed synchronously by execute(), or it can be submitted by
+     * submit() and waited for later by wait(). In the latter case,
+     * a thread can have several operations performed in parallel.
+     *
+     * The operation contains the links and the state needed to queue
+     * and wait for it, so no memory is allocated for these. It should
+     * not be destroyed while it is queued or running.
+     *
+     * If the operation is abandonable, waiting for it can fail even
+     * while it is running, and if waiting fails for whatever reason,
+     * the operation is owned by the server, which discards it (at
+     * once, or once it has been performed) by calling discard(). This
+     * also holds for a failed IOServer::execute().
      */
     class Operation
     {
     public:
         /**
-         * Virtual destructor.
+         * The state of an operation.
+         */
+        typedef enum {
+            /// The operation has not been submitted
+            IDLE,
+
+            /// The operation is in the submission queue
+            QUEUED,
+
+            /// The operation is being performed by a worker
+            RUNNING,
+
+            /// The operation has been performed
+            COMPLETED,
+
+            /// The operation has been cancelled while queued
+            CANCELLED
+        } state_t;
+
+    private:
+        /**
+         * The next operation in the submission queue or the
+         * completion stack.
+         */
+        Operation* next;
+
+        /**
+         * The state of the operation. It is changed by the workers
+         * with the mutex held, but it may be read by the scheduler's
+         * thread without it.
+         */
+        std::atomic<state_t> state;
+
+        /**
+         * The thread waiting for the operation, if any.
+         */
+        BlockedThread* waiter;
+
+        /**
+         * The time the operation was submitted.
+         */
+        nanos_t submitTime;
+
+        /**
+         * The lane of the operation.
+         */
+        lane_t lane;
+
+        /**
+         * Indicate if the operation can be abandoned while running.
+         */
+        bool abandonable;
+
+        /**
+         * Indicate if the operation has been abandoned while running,
+         * and so it should be discarded when completed.
+         */
+        bool abandoned;
+
+    public:
+        /**
+         * Construct the operation for the given lane.
+         */
+        Operation(lane_t lane = LATENCY);
+
+        /**
+         * Destroy the operation. It should not be queued or running.
          */
         virtual ~Operation();
 
+        /**
+         * Get the state of the operation.
+         */
+        state_t getState() const;
+
+        /**
+         * Get the lane of the operation.
+         */
+        lane_t getLane() const;
+
+        /**
+         * Set the lane of the operation. It should not be pending.
+         */
+        void setLane(lane_t l);
+
+        /**
+         * Determine if the operation can be abandoned while running.
+         */
+        bool isAbandonable() const;
+
+        /**
+         * Set whether the operation can be abandoned while running.
+         * An abandonable operation is owned by the server once waiting
+         * for it fails, so it should be allocated by new, or discard()
+         * should be overridden. It should not be pending.
+         */
+        void setAbandonable(bool a);
+
+        /**
+         * Determine if the operation has been submitted, but has not
+         * completed yet.
+         */
+        bool isPending() const;
+
+        /**
+         * Determine if the operation has been completed.
+         */
+        bool isCompleted() const;
+
+        /**
+         * Wait for the operation to complete. It can be called by one
+         * thread at a time. While the operation is queued, the
+         * waiting obeys the deadline and cancellation of the current
+         * thread: if the deadline expires, the operation is removed
+         * from the queue, and false is returned with errno set to
+         * ETIMEDOUT (or ECANCELED if cancelled). Once the operation
+         * is started, it is waited for regardless of the deadline,
+         * unless it is abandonable, in which case it is abandoned.
+         *
+         * @return if the operation has been completed. If it has not
+         * been submitted, false is returned with errno set to EINVAL.
+         * If it has been cancelled by cancel(), before or during the
+         * waiting, false is returned with errno set to ECANCELED (and
+         * an abandonable operation is discarded).
+         */
+        bool wait();
+
+        /**
+         * Cancel the operation, if it is still queued. Its state
+         * becomes CANCELLED. The thread waiting for it, if any, is
+         * woken up, and its waiting fails with errno set to
+         * ECANCELED. If nobody is waiting for it, it can still be
+         * waited for (failing the same way) or destroyed.
+         *
+         * @return if the operation has been cancelled. If not, errno
+         * is set to EBUSY if the operation is running, or to EINVAL
+         * if it is not pending.
+         */
+        bool cancel();
+
+        /**
+         * Abandon the operation, which should not be waited for. If
+         * it is running, it is discarded once it has been performed,
+         * otherwise it is discarded at once (after removing it from
+         * the queue, if it is queued).
+         */
+        void abandon();
+
     protected:
         /**
          * Perform the operation in the worker thread.
          */
         virtual void perform() = 0;
 
+        /**
+         * Discard the operation after it has been abandoned. It is
+         * called in the scheduler's thread. The default implementation
+         * deletes the operation. It can be overridden, e.g. to release
+         * the resources the operation has obtained (like a file
+         * descriptor opened).
+         */
+        virtual void discard();
+
         friend class IOServer;
     };
 
@@ -74,9 +295,9 @@ public:
 
     public:
         /**
-         * Construct the operation.
+         * Construct the operation for the given lane.
          */
-        ErrnoOperation();
+        ErrnoOperation(lane_t lane = LATENCY);
 
         /**
          * Get the error number.
@@ -96,11 +317,215 @@ public:
         virtual void performErrno() = 0;
     };
 
+    /**
+     * The value returned by call() if the function could not be
+     * called. It is -1 for signed integral types (like the return
+     * value of most system calls), and a value-initialized object
+     * (e.g. 0 or false) otherwise. It should be specialized for the
+     * types that are not default-constructible, like references, in
+     * order to use them with call().
+     */
+    template <typename R, typename Enable = void>
+    struct FailureValue
+    {
+        static_assert(std::is_default_constructible<R>::value,
+                      "IOServer::FailureValue should be specialized for "
+                      "a result type that is not default-constructible "
+                      "(e.g. a reference) to use it with IOServer::call()");
+
+        static R get();
+    };
+
 private:
     /**
-     * A worker thread.
+     * Storage for the result of a function called by call(). The
+     * result is constructed only when the function returns, so the
+     * type need not be default-constructible or assignable.
      */
-    class Worker;
+    template <typename R>
+    class CallResult
+    {
+    private:
+        /**
+         * The storage of the value.
+         */
+        union {
+            R value;
+        };
+
+        /**
+         * Indicate if the value has been constructed.
+         */
+        bool valid;
+
+    public:
+        /**
+         * Construct the storage without a value.
+         */
+        CallResult();
+
+        /**
+         * Destroy the value, if any.
+         */
+        ~CallResult();
+
+    private:
+        CallResult(const CallResult&);
+        CallResult& operator=(const CallResult&);
+
+    public:
+        /**
+         * Call the given function and store its result.
+         */
+        template <class F> void call(F& function);
+
+        /**
+         * Get the result.
+         */
+        R get();
+    };
+
+    /**
+     * An operation calling a function for call(). Both the function
+     * and the operation reside in the stack of the calling thread.
+     */
+    template <class F>
+    class CallOperation : public Operation
+    {
+    public:
+        /**
+         * The type of the function's result.
+         */
+        typedef decltype(std::declval<F&>()()) result_t;
+
+    private:
+        /**
+         * The function to call.
+         */
+        F& function;
+
+        /**
+         * The error number. Initially it is the caller's one, so that
+         * the function sees the same errno as if it was called
+         * directly.
+         */
+        int errorNumber;
+
+        /**
+         * The result.
+         */
+        CallResult<result_t> result;
+
+    public:
+        /**
+         * Construct the operation.
+         */
+        CallOperation(lane_t lane, F& function);
+
+        /**
+         * Get the error number.
+         */
+        int getErrorNumber() const;
+
+        /**
+         * Get the result.
+         */
+        result_t getResult();
+
+    protected:
+        /**
+         * Call the function.
+         */
+        virtual void perform();
+    };
+
+public:
+
+    /**
+     * The default time an operation can wait in the queue before a
+     * new worker is started.
+     */
+    static const nanos_t DEFAULT_GROW_THRESHOLD = 2*NANOS_PER_MILLI;
+
+    /**
+     * The default time after which an idle worker above the minimum
+     * exits.
+     */
+    static const nanos_t DEFAULT_IDLE_TIMEOUT = 10000*NANOS_PER_MILLI;
+
+    /**
+     * The default maximal number of workers per CPU available.
+     */
+    static const size_t DEFAULT_WORKERS_PER_CPU = 4;
+
+    /**
+     * The default number of workers reserved for the LATENCY lane.
+     */
+    static const size_t DEFAULT_LATENCY_RESERVE = 1;
+
+private:
+    /**
+     * A submission queue.
+     */
+    class Queue
+    {
+    private:
+        /**
+         * The first operation in the queue.
+         */
+        Operation* first;
+
+        /**
+         * The last operation in the queue.
+         */
+        Operation* last;
+
+        /**
+         * The number of operations in the queue.
+         */
+        size_t length;
+
+    public:
+        /**
+         * Construct an empty queue.
+         */
+        Queue();
+
+        /**
+         * Determine if the queue is empty.
+         */
+        bool empty() const;
+
+        /**
+         * Get the number of operations in the queue.
+         */
+        size_t size() const;
+
+        /**
+         * Get the first operation in the queue, if any.
+         */
+        Operation* front() const;
+
+        /**
+         * Append the given operation to the queue.
+         */
+        void push(Operation* operation);
+
+        /**
+         * Remove and return the first operation in the queue.
+         */
+        Operation* pop();
+
+        /**
+         * Remove the given operation from the queue.
+         */
+        void remove(Operation* operation);
+    };
+
+    /**
+     * The eventfd notifying the scheduler of completions.
+     */
+    class CompletionFD;
 
     /**
      * The only instance of this server.
@@ -113,38 +538,217 @@ public:
      */
     static IOServer& get();
 
+    /**
+     * Get the number of CPUs available to the process. It is the
+     * number of CPUs the process may run on, further limited by the
+     * CPU quota of the process' cgroup, if any (rounded up).
+     */
+    static size_t getCPULimit();
+
+    /**
+     * Call the given function with the given arguments in a worker
+     * thread in the LATENCY lane, e.g.
+     *
+     *   ssize_t n = IOServer::call(::pread, fd, buf, count, offset);
+     *
+     * Nothing is allocated for the call: the arguments are passed by
+     * reference, and the operation is in the caller's stack. The
+     * errno set by the function is returned to the caller.
+     *
+     * The deadline and the cancellation of the current thread are
+     * handled like in execute(). If the function could not be called
+     * (e.g. it timed out while queued), FailureValue<R>::get() is
+     * returned and errno is set as by execute(). Since the arguments
+     * are referenced by the operation, a running call is not
+     * abandoned.
+     */
+    template <typename F, typename... Args>
+    static auto call(F&& f, Args&&... args)
+        -> decltype(f(std::forward<Args>(args)...));
+
+    /**
+     * Call the given function with the given arguments in a worker
+     * thread in the given lane.
+     *
+     * @see call()
+     */
+    template <typename F, typename... Args>
+    static auto callInLane(lane_t lane, F&& f, Args&&... args)
+        -> decltype(f(std::forward<Args>(args)...));
+
+private:
+    /**
+     * The start routine of the worker threads.
+     */
+    static void* startWorker(void* arg);
+
 private:
     /**
-     * All the workers.
+     * The mutex protecting the submission queue and the related
+     * variables.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * The condition variable the idle workers wait on.
+     */
+    pthread_cond_t condition;
+
+    /**
+     * The submission queues of the lanes.
      */
-    Worker* workers;
+    Queue queues[NUM_LANES];
 
     /**
-     * Available workers.
+     * The number of operations in the submission queues.
      */
-    std::vector<Worker*> availableWorkers;
+    size_t numQueued;
 
     /**
-     * The threads waiting for workers.
+     * The number of idle workers.
      */
-    std::deque<BlockedThread*> waiters;
+    size_t numIdle;
+
+    /**
+     * Indicate if the server is stopping.
+     */
+    bool stopping;
+
+    /**
+     * The minimal number of workers.
+     */
+    size_t minWorkers;
+
+    /**
+     * The maximal number of workers.
+     */
+    size_t maxWorkers;
+
+    /**
+     * The time an operation can wait in the queue before a new worker
+     * is started.
+     */
+    nanos_t growThreshold;
+
+    /**
+     * The time after which an idle worker above the minimum exits.
+     */
+    nanos_t idleTimeout;
+
+    /**
+     * The current number of workers.
+     */
+    size_t numWorkers;
+
+    /**
+     * Indicate if a worker has been started, but it has not begun
+     * taking operations yet.
+     */
+    bool growing;
+
+    /**
+     * The maximal number of BULK operations running at the same time.
+     */
+    size_t maxRunningBulk;
+
+    /**
+     * The number of BULK operations running.
+     */
+    size_t numRunningBulk;
+
+    /**
+     * The top of the completion stack.
+     */
+    std::atomic<Operation*> completed;
+
+    /**
+     * The file descriptor notifying the scheduler of completions.
+     */
+    CompletionFD* completionFD;
+
+    /**
+     * The number of operations submitted but not drained from the
+     * completion stack yet. It is accessed only by the scheduler's
+     * thread.
+     */
+    size_t numOutstanding;
 
 public:
     /**
-     * Construct the I/O server with the given number of worker threads.
+     * Construct the I/O server with the given, fixed number of worker
+     * threads.
      */
     IOServer(size_t numWorkers);
 
+    /**
+     * Construct the I/O server with a pool of workers between the
+     * given bounds. The minimal number of workers are started
+     * immediately.
+     *
+     * @param growThreshold the time an operation can wait in the
+     * queue before a new worker is started
+     * @param idleTimeout the time after which an idle worker exits,
+     * if there are more than the minimal number of workers
+     * @param latencyReserve the number of workers reserved for the
+     * LATENCY lane. At least one BULK operation can run, though, even
+     * if it is not less than the maximal number of workers.
+     */
+    IOServer(size_t minWorkers, size_t maxWorkers,
+             nanos_t growThreshold = DEFAULT_GROW_THRESHOLD,
+             nanos_t idleTimeout = DEFAULT_IDLE_TIMEOUT,
+             size_t latencyReserve = DEFAULT_LATENCY_RESERVE);
+
+    /**
+     * Construct the I/O server with a pool of one to
+     * DEFAULT_WORKERS_PER_CPU times getCPULimit() workers.
+     */
+    IOServer();
+
     /**
      * Destroy the I/O server.
      */
     ~IOServer();
 
     /**
-     * Execute the given operation.
+     * Execute the given operation, i.e. submit it and wait for it to
+     * complete. See Operation::wait() for how the deadline of the
+     * current thread is handled. If the execution fails, an
+     * abandonable operation is discarded.
+     *
+     * @param canBlock if false, the operation is executed only if
+     * there is an idle worker for it, otherwise false is returned
+     * with errno set to EAGAIN.
      */
     bool execute(Operation* operation, bool canBlock = true);
 
+    /**
+     * Submit the given operation for execution, but do not wait for
+     * it. It should be waited for by Operation::wait() before it is
+     * destroyed.
+     *
+     * @param canBlock if false, the operation is submitted only if
+     * there is an idle worker for it, otherwise false is returned
+     * with errno set to EAGAIN.
+     *
+     * @return if the operation could be submitted. If not, errno is
+     * set to EAGAIN, or to ECANCELED if the server is stopped.
+     */
+    bool submit(Operation* operation, bool canBlock = true);
+
+    /**
+     * Cancel the given operation.
+     *
+     * @see Operation::cancel()
+     */
+    bool cancel(Operation* operation);
+
+    /**
+     * Abandon the given operation.
+     *
+     * @see Operation::abandon()
+     */
+    void abandon(Operation* operation);
+
     /**
      * Execute the given operation in non-blocking mode, i.e. if there
      * is no worker available immediately, return at once.
@@ -152,35 +756,168 @@ public:
     bool executeNonBlocking(Operation* operation);
 
     /**
-     * Stop the I/O server by closing all file descriptors.
+     * Get the current number of workers.
+     */
+    size_t getNumWorkers();
+
+    /**
+     * Stop the I/O server. The operations already submitted are
+     * performed, and then the workers are stopped. Operations
+     * executed later fail with errno set to ECANCELED.
      */
     void stop();
 
 private:
     /**
-     * Get an available worker.
+     * Initialize the server and start the minimal number of workers.
      */
-    Worker* getWorker(bool canBlock);
+    void init();
 
     /**
-     * Release a worker being used. If there are any waiters, the
-     * first one is woken up.
+     * Start a new worker thread. The mutex should be locked.
+     *
+     * @return if the thread could be started
      */
-    void putWorker(Worker* worker);
+    bool addWorker();
+
+    /**
+     * Start a new worker thread, if an operation waited for the
+     * given time in the queue, and the pool can and may grow. The
+     * mutex should be locked.
+     */
+    void grow(nanos_t waitTime);
+
+    /**
+     * Get the queue a worker should take the next operation from. The
+     * mutex should be locked.
+     *
+     * @return the queue, or 0 if there is nothing to take
+     */
+    Queue* getTakeableQueue();
+
+    /**
+     * Perform the operations in a worker thread until it is stopped
+     * or it is idle for too long.
+     */
+    void runWorker();
+
+    /**
+     * Wait for the given operation to complete.
+     *
+     * @see Operation::wait()
+     */
+    bool wait(Operation* operation);
+
+    /**
+     * Remove the given operation from the submission queue, if it is
+     * still there.
+     *
+     * @return if the operation was removed
+     */
+    bool dequeue(Operation* operation);
+
+    /**
+     * Take the next operation from the submission queues for the
+     * calling worker. If there is nothing to take, the worker waits.
+     *
+     * @param finishedBulk indicate if the worker has just finished a
+     * BULK operation
+     * @return the operation, or 0 if the server is stopping or the
+     * worker should exit due to being idle
+     */
+    Operation* take(bool finishedBulk);
+
+    /**
+     * Push the given operation onto the completion stack. It is called
+     * by the workers.
+     */
+    void complete(Operation* operation);
+
+    /**
+     * Drain the completion stack and unblock the waiting threads.
+     */
+    void drainCompleted();
 };
 
 //------------------------------------------------------------------------------
 // Inline definitions
 //------------------------------------------------------------------------------
 
+inline IOServer::Operation::Operation(lane_t lane) :
+    next(0),
+    state(IDLE),
+    waiter(0),
+    submitTime(0),
+    lane(lane),
+    abandonable(false),
+    abandoned(false)
+{
+}
+
+//------------------------------------------------------------------------------
+
 inline IOServer::Operation::~Operation()
 {
+    assert(!isPending());
+}
+
+//------------------------------------------------------------------------------
+
+inline IOServer::Operation::state_t IOServer::Operation::getState() const
+{
+    return state.load(std::memory_order_acquire);
+}
+
+//------------------------------------------------------------------------------
+
+inline IOServer::lane_t IOServer::Operation::getLane() const
+{
+    return lane;
+}
+
+//------------------------------------------------------------------------------
+
+inline void IOServer::Operation::setLane(lane_t l)
+{
+    assert(!isPending());
+    lane = l;
 }
 
 //------------------------------------------------------------------------------
+
+inline bool IOServer::Operation::isAbandonable() const
+{
+    return abandonable;
+}
+
+//------------------------------------------------------------------------------
+
+inline void IOServer::Operation::setAbandonable(bool a)
+{
+    assert(!isPending());
+    abandonable = a;
+}
+
 //------------------------------------------------------------------------------
 
-inline IOServer::ErrnoOperation::ErrnoOperation() :
+inline bool IOServer::Operation::isPending() const
+{
+    state_t s = getState();
+    return s==QUEUED || s==RUNNING;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool IOServer::Operation::isCompleted() const
+{
+    return getState()==COMPLETED;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline IOServer::ErrnoOperation::ErrnoOperation(lane_t lane) :
+    Operation(lane),
     errorNumber(0)
 {
 }
@@ -209,6 +946,177 @@ inline bool IOServer::executeNonBlocking(Operation* operation)
 
 //------------------------------------------------------------------------------
 
+inline bool IOServer::execute(Operation* operation, bool canBlock)
+{
+    if (submit(operation, canBlock)) {
+        return wait(operation);
+    } else {
+        if (operation->abandonable) operation->discard();
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+template <typename F, typename... Args>
+inline auto IOServer::call(F&& f, Args&&... args)
+    -> decltype(f(std::forward<Args>(args)...))
+{
+    return callInLane(LATENCY, std::forward<F>(f),
+                      std::forward<Args>(args)...);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename F, typename... Args>
+auto IOServer::callInLane(lane_t lane, F&& f, Args&&... args)
+    -> decltype(f(std::forward<Args>(args)...))
+{
+    typedef decltype(f(std::forward<Args>(args)...)) result_t;
+
+    auto function = [&]() -> result_t {
+        return f(std::forward<Args>(args)...);
+    };
+
+    CallOperation<decltype(function)> operation(lane, function);
+    if (get().execute(&operation)) {
+        errno = operation.getErrorNumber();
+        return operation.getResult();
+    } else {
+        return FailureValue<result_t>::get();
+    }
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <typename R, typename Enable>
+inline R IOServer::FailureValue<R, Enable>::get()
+{
+    return R();
+}
+
+//------------------------------------------------------------------------------
+
+template <typename R>
+struct IOServer::FailureValue<R,
+                              typename std::enable_if<
+                                  std::is_integral<R>::value &&
+                                  std::is_signed<R>::value>::type>
+{
+    static R get() { return -1; }
+};
+
+//------------------------------------------------------------------------------
+
+template <>
+struct IOServer::FailureValue<void>
+{
+    static void get() {}
+};
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <typename R>
+inline IOServer::CallResult<R>::CallResult() :
+    valid(false)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <typename R>
+inline IOServer::CallResult<R>::~CallResult()
+{
+    if (valid) value.~R();
+}
+
+//------------------------------------------------------------------------------
+
+template <typename R> template <class F>
+inline void IOServer::CallResult<R>::call(F& function)
+{
+    new (&value) R(function());
+    valid = true;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename R>
+inline R IOServer::CallResult<R>::get()
+{
+    assert(valid);
+    return std::move(value);
+}
+
+//------------------------------------------------------------------------------
+
+template <typename R>
+class IOServer::CallResult<R&>
+{
+private:
+    R* value;
+
+public:
+    CallResult() : value(0) {}
+
+    template <class F> void call(F& function) { value = &function(); }
+
+    R& get() { assert(value!=0); return *value; }
+};
+
+//------------------------------------------------------------------------------
+
+template <>
+class IOServer::CallResult<void>
+{
+public:
+    template <class F> void call(F& function) { function(); }
+
+    void get() {}
+};
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <class F>
+inline IOServer::CallOperation<F>::CallOperation(lane_t lane, F& function) :
+    Operation(lane),
+    function(function),
+    errorNumber(errno)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <class F>
+inline int IOServer::CallOperation<F>::getErrorNumber() const
+{
+    return errorNumber;
+}
+
+//------------------------------------------------------------------------------
+
+template <class F>
+inline typename IOServer::CallOperation<F>::result_t
+IOServer::CallOperation<F>::getResult()
+{
+    return result.get();
+}
+
+//------------------------------------------------------------------------------
+
+template <class F>
+void IOServer::CallOperation<F>::perform()
+{
+    errno = errorNumber;
+    result.call(function);
+    errorNumber = errno;
+}
+
+//------------------------------------------------------------------------------
+
 } /* namespace lwt */
 
 //------------------------------------------------------------------------------
@@ -219,4 +1127,3 @@ inline bool IOServer::executeNonBlocking(Operation* operation)
 // c-basic-offset: 4
 // indent-tabs-mode: nil
 // End:
-
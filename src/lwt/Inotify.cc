@@ -0,0 +1,137 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+//------------------------------------------------------------------------------
+
+#include "Inotify.h"
+
+#include "Clock.h"
+#include "IOServer.h"
+#include "Thread.h"
+
+#include <cerrno>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+
+using lwt::Inotify;
+using lwt::IOServer;
+using lwt::Thread;
+using lwt::Clock;
+
+//------------------------------------------------------------------------------
+
+const size_t Inotify::BUFFER_SIZE;
+
+//------------------------------------------------------------------------------
+
+const size_t Inotify::MAX_EVENT_SIZE;
+
+//------------------------------------------------------------------------------
+
+int Inotify::addWatch(const char* path, uint32_t mask)
+{
+    return IOServer::call(::inotify_add_watch, fd, path, mask);
+}
+
+//------------------------------------------------------------------------------
+
+ssize_t Inotify::readEvents(nanos_t settleTime)
+{
+    length = offset = 0;
+
+    ssize_t result = read(buffer, BUFFER_SIZE);
+    if (result<0) return -1;
+    length = result;
+
+    if (settleTime>0) {
+        while ((BUFFER_SIZE-length)>=MAX_EVENT_SIZE) {
+            Thread::DeadlineScope deadlineScope(Clock::now() + settleTime);
+            // A timeout means the burst is over, and any other error
+            // will be reported by the next call
+            result = read(buffer + length, BUFFER_SIZE - length);
+            if (result<=0) break;
+            length += result;
+        }
+    }
+
+    return coalesce();
+}
+
+//------------------------------------------------------------------------------
+
+ssize_t Inotify::readAvailableEvents()
+{
+    length = offset = 0;
+
+    ssize_t result = PolledFD::read(buffer, BUFFER_SIZE);
+    if (result<0) {
+        return (errno==EAGAIN || errno==EWOULDBLOCK) ? 0 : -1;
+    }
+    length = result;
+
+    return coalesce();
+}
+
+//------------------------------------------------------------------------------
+
+size_t Inotify::coalesce()
+{
+    size_t numEvents = 0;
+    size_t newLength = 0;
+
+    for(size_t eventOffset = 0; eventOffset<length;) {
+        struct inotify_event* event = getEvent(eventOffset);
+        size_t eventSize = sizeof(struct inotify_event) + event->len;
+        eventOffset += eventSize;
+
+        if (event->cookie==0) {
+            bool merged = false;
+            for(size_t o = 0; o<newLength && !merged;) {
+                struct inotify_event* e = getEvent(o);
+                if (e->wd==event->wd && e->cookie==0 && e->len==event->len &&
+                    (event->len==0 || strcmp(e->name, event->name)==0))
+                {
+                    e->mask |= event->mask;
+                    merged = true;
+                }
+                o += sizeof(struct inotify_event) + e->len;
+            }
+            if (merged) continue;
+        }
+
+        struct inotify_event* destination = getEvent(newLength);
+        if (destination!=event) memmove(destination, event, eventSize);
+        newLength += eventSize;
+        ++numEvents;
+    }
+
+    length = newLength;
+    offset = 0;
+
+    return numEvents;
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
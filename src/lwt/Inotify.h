@@ -0,0 +1,231 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_INOTIFY_H
+#define LWT_INOTIFY_H
+//------------------------------------------------------------------------------
+
+#include "ThreadedFD.h"
+#include "util.h"
+
+#include <climits>
+#include <cstddef>
+
+#include <sys/inotify.h>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * An inotify file descriptor that threads can block on to wait for
+ * file system events.
+ *
+ * The events are read into an internal buffer, and they can be
+ * iterated over with nextEvent(), which returns pointers into the
+ * buffer, so the variable-length event records are never copied.
+ *
+ * A burst of events is coalesced: the events of a batch that refer to
+ * the same watch and name are merged into the first one by combining
+ * their masks. The mask of a merged event thus means that one or more
+ * of the given changes have happened, but not their order. Events with
+ * a cookie (i.e. renames) are not merged, so that they can be paired.
+ */
+class Inotify : public ThreadedFD
+{
+public:
+    /**
+     * The size of the event buffer.
+     */
+    static const size_t BUFFER_SIZE = 16*1024;
+
+private:
+    /**
+     * The maximal size of one event.
+     */
+    static const size_t MAX_EVENT_SIZE =
+        sizeof(struct inotify_event) + NAME_MAX + 1;
+
+    /**
+     * The buffer of the events.
+     */
+    alignas(struct inotify_event) char buffer[BUFFER_SIZE];
+
+    /**
+     * The number of bytes in the buffer.
+     */
+    size_t length;
+
+    /**
+     * The offset of the next event to return.
+     */
+    size_t offset;
+
+public:
+    /**
+     * Construct the inotify file descriptor. If it cannot be created,
+     * isOpen() returns false and errno is set.
+     */
+    Inotify();
+
+protected:
+    /**
+     * Destroy the file descriptor.
+     */
+    virtual ~Inotify();
+
+public:
+    /**
+     * Determine if the file descriptor is open.
+     */
+    bool isOpen() const;
+
+    /**
+     * Get the file descriptor.
+     */
+    int getFD() const;
+
+    /**
+     * Add a watch for the given path. Since resolving the path may
+     * block on the disk, it is performed by the I/O server.
+     *
+     * @return the watch descriptor, or -1 on error
+     */
+    int addWatch(const char* path, uint32_t mask);
+
+    /**
+     * Remove the watch with the given descriptor.
+     */
+    int removeWatch(int wd);
+
+    /**
+     * Read the next batch of events, blocking until at least one
+     * event arrives. If settleTime is not 0, reading continues until
+     * no more events arrive for that long, or the buffer is full, so
+     * that a burst of events is returned (and coalesced) together.
+     *
+     * The events of the previous batch are discarded.
+     *
+     * @return the number of events, or -1 on error (e.g. the deadline
+     * of the thread expired)
+     */
+    ssize_t readEvents(nanos_t settleTime = 0);
+
+    /**
+     * Read the events available without blocking.
+     *
+     * The events of the previous batch are discarded.
+     *
+     * @return the number of events, which is 0 if there were none,
+     * or -1 on error
+     */
+    ssize_t readAvailableEvents();
+
+    /**
+     * Get the next event of the current batch.
+     *
+     * @return the event, pointing into the internal buffer, or 0 if
+     * all events have been returned. The event is valid until the
+     * next batch is read.
+     */
+    const struct inotify_event* nextEvent();
+
+private:
+    /**
+     * Get the event at the given offset of the buffer.
+     */
+    struct inotify_event* getEvent(size_t eventOffset);
+
+    /**
+     * Coalesce the events in the buffer and reset the offset.
+     *
+     * @return the number of events remaining
+     */
+    size_t coalesce();
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline Inotify::Inotify() :
+    ThreadedFD(::inotify_init1(IN_NONBLOCK|IN_CLOEXEC)),
+    length(0),
+    offset(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline Inotify::~Inotify()
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline bool Inotify::isOpen() const
+{
+    return fd>=0;
+}
+
+//------------------------------------------------------------------------------
+
+inline int Inotify::getFD() const
+{
+    return fd;
+}
+
+//------------------------------------------------------------------------------
+
+inline int Inotify::removeWatch(int wd)
+{
+    return ::inotify_rm_watch(fd, wd);
+}
+
+//------------------------------------------------------------------------------
+
+inline const struct inotify_event* Inotify::nextEvent()
+{
+    if (offset>=length) return 0;
+
+    const struct inotify_event* event = getEvent(offset);
+    offset += sizeof(struct inotify_event) + event->len;
+    return event;
+}
+
+//------------------------------------------------------------------------------
+
+inline struct inotify_event* Inotify::getEvent(size_t eventOffset)
+{
+    return reinterpret_cast<struct inotify_event*>(buffer + eventOffset);
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_INOTIFY_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -21,7 +21,9 @@
 
 #include "Log.h"
 #include "Thread.h"
+#include "Clock.h"
 
+#include <cstring>
 #include <ctime>
 
 //------------------------------------------------------------------------------
@@ -40,13 +42,36 @@ string Log::logFileName;
 
 //------------------------------------------------------------------------------
 
+char Log::timePrefix[32];
+
+//------------------------------------------------------------------------------
+
+size_t Log::timePrefixLength = 0;
+
+//------------------------------------------------------------------------------
+
+nanos_t Log::timePrefixExpiration = 0;
+
+//------------------------------------------------------------------------------
+
 void Log::log(bool error, const char* format, va_list& ap)
 {
     char buf[1024];    
     size_t offset = 0;
 
-    time_t t = time(0);
-    offset += strftime(buf, sizeof(buf), "%F %T: ", localtime(&t));
+    nanos_t now = Clock::get();
+    if (now>=timePrefixExpiration) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+
+        struct tm tm;
+        localtime_r(&ts.tv_sec, &tm);
+        timePrefixLength = strftime(timePrefix, sizeof(timePrefix),
+                                    "%F %T: ", &tm);
+        timePrefixExpiration = now + 1000000000 - ts.tv_nsec;
+    }
+    memcpy(buf, timePrefix, timePrefixLength);
+    offset += timePrefixLength;
 
     Thread* current = Thread::getCurrent();
     if (current!=0) {
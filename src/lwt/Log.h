@@ -21,6 +21,8 @@
 #define LWT_LOG_H
 //------------------------------------------------------------------------------
 
+#include "util.h"
+
 #include <string>
 
 #include <cstdio>
@@ -61,6 +63,22 @@ public:
     static void cont(bool error, const char* format, va_list& ap);
 
 private:
+    /**
+     * The formatted time prefix of the log entries of the current
+     * second.
+     */
+    static char timePrefix[32];
+
+    /**
+     * The length of the time prefix.
+     */
+    static size_t timePrefixLength;
+
+    /**
+     * The monotonic time when the time prefix expires.
+     */
+    static nanos_t timePrefixExpiration;
+
     /**
      * Output the given string into all log destinations
      */
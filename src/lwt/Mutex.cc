@@ -0,0 +1,55 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+//------------------------------------------------------------------------------
+
+#include "Mutex.h"
+
+//------------------------------------------------------------------------------
+
+using lwt::Mutex;
+using lwt::Thread;
+
+//------------------------------------------------------------------------------
+
+bool Mutex::lock()
+{
+    if (tryLock()) return true;
+
+    assert(owner!=Thread::getCurrent());
+    if (!waiters.wait()) return false;
+
+    assert(owner==Thread::getCurrent());
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+void Mutex::unlock()
+{
+    assert(owner==Thread::getCurrent());
+    owner = waiters.notifyOne();
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,202 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_MUTEX_H
+#define LWT_MUTEX_H
+//------------------------------------------------------------------------------
+
+#include "WaitQueue.h"
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A mutual exclusion lock for the threads. The threads waiting for
+ * the lock are served in FIFO order: when the mutex is unlocked, it
+ * is handed over to the first waiting thread directly.
+ *
+ * Since the threads are cooperative, a mutex is only needed if a
+ * critical section contains a blocking operation.
+ */
+class Mutex
+{
+public:
+    /**
+     * A scope holding the lock of a mutex.
+     */
+    class Lock
+    {
+    private:
+        /**
+         * The mutex.
+         */
+        Mutex& mutex;
+
+        /**
+         * Indicate if the locking has succeeded.
+         */
+        bool locked;
+
+    public:
+        /**
+         * Construct the scope by locking the given mutex.
+         */
+        Lock(Mutex& mutex);
+
+        /**
+         * Destroy the scope by unlocking the mutex, if it was locked.
+         */
+        ~Lock();
+
+        /**
+         * Determine if the mutex could be locked.
+         */
+        bool isLocked() const;
+    };
+
+private:
+    /**
+     * The thread owning the mutex, if it is locked.
+     */
+    Thread* owner;
+
+    /**
+     * The threads waiting for the mutex.
+     */
+    WaitQueue waiters;
+
+public:
+    /**
+     * Construct the mutex.
+     */
+    Mutex();
+
+    /**
+     * Destroy the mutex. It should not be locked.
+     */
+    ~Mutex();
+
+    /**
+     * Lock the mutex, waiting for it, if it is locked by another
+     * thread.
+     *
+     * @return if the mutex has been locked. If not, errno is set to
+     * ETIMEDOUT or ECANCELED.
+     */
+    bool lock();
+
+    /**
+     * Lock the mutex, if it is not locked.
+     *
+     * @return if the mutex has been locked.
+     */
+    bool tryLock();
+
+    /**
+     * Unlock the mutex. It should be locked by the current thread.
+     */
+    void unlock();
+
+    /**
+     * Determine if the mutex is locked.
+     */
+    bool isLocked() const;
+
+    /**
+     * Get the thread owning the mutex.
+     */
+    Thread* getOwner() const;
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline Mutex::Lock::Lock(Mutex& mutex) :
+    mutex(mutex),
+    locked(mutex.lock())
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline Mutex::Lock::~Lock()
+{
+    if (locked) mutex.unlock();
+}
+
+//------------------------------------------------------------------------------
+
+inline bool Mutex::Lock::isLocked() const
+{
+    return locked;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline Mutex::Mutex() :
+    owner(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline Mutex::~Mutex()
+{
+    assert(owner==0);
+}
+
+//------------------------------------------------------------------------------
+
+inline bool Mutex::tryLock()
+{
+    if (owner!=0) return false;
+    owner = Thread::getCurrent();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool Mutex::isLocked() const
+{
+    return owner!=0;
+}
+
+//------------------------------------------------------------------------------
+
+inline Thread* Mutex::getOwner() const
+{
+    return owner;
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_MUTEX_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,65 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+//------------------------------------------------------------------------------
+
+#include "PeriodicTimer.h"
+#include "Clock.h"
+
+//------------------------------------------------------------------------------
+
+using lwt::PeriodicTimer;
+
+//------------------------------------------------------------------------------
+
+void PeriodicTimer::start()
+{
+    nanos_t now = Clock::now();
+    nanos_t deadline = now - (now % period) + phase;
+    if (deadline<now) deadline += period;
+    schedule(deadline);
+}
+
+//------------------------------------------------------------------------------
+
+bool PeriodicTimer::handleTimeout()
+{
+    nanos_t next = timeout + period;
+
+    unsigned long long missed = 0;
+    if (policy==SKIP) {
+        nanos_t now = Clock::now();
+        if (next<=now) {
+            missed = (now - timeout) / period;
+            next = timeout + (missed + 1) * period;
+        }
+    }
+
+    if (!handlePeriod(missed)) return false;
+
+    if (!isPending()) timeout = next;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
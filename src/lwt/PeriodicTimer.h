@@ -0,0 +1,169 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_PERIODICTIMER_H
+#define LWT_PERIODICTIMER_H
+//------------------------------------------------------------------------------
+
+#include "Timer.h"
+
+#include <cassert>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A timer that expires periodically. The deadlines are the times
+ * that equal to the phase modulo the period. The next deadline is
+ * always computed from the previous ideal deadline, and not from the
+ * time the timer actually expired, so the slack and any delays do
+ * not accumulate.
+ *
+ * It is not deleted by the timer subsystem, so it can be embedded
+ * into its owner.
+ */
+class PeriodicTimer : public Timer
+{
+public:
+    /**
+     * The policy for the periods missed, e.g. because the scheduler
+     * was busy.
+     */
+    typedef enum {
+        /// The handler is called for each missed period one after
+        /// the other
+        CATCH_UP,
+
+        /// The missed periods are skipped, and the handler is called
+        /// only once with the number of periods skipped
+        SKIP
+    } policy_t;
+
+private:
+    /**
+     * The period.
+     */
+    nanos_t period;
+
+    /**
+     * The phase.
+     */
+    nanos_t phase;
+
+    /**
+     * The policy for the missed periods.
+     */
+    policy_t policy;
+
+public:
+    /**
+     * Construct the timer. It is not started. The period should be
+     * positive.
+     */
+    PeriodicTimer(nanos_t period, nanos_t phase = 0,
+                  policy_t policy = SKIP);
+
+    /**
+     * Get the period.
+     */
+    nanos_t getPeriod() const;
+
+    /**
+     * Get the next deadline. It is valid only if the timer is
+     * pending.
+     */
+    nanos_t getDeadline() const;
+
+    /**
+     * Start the timer. The first deadline will be the earliest one
+     * not before the current time.
+     */
+    void start();
+
+    /**
+     * Stop the timer.
+     */
+    void stop();
+
+protected:
+    /**
+     * Call handlePeriod() and compute the next deadline.
+     */
+    virtual bool handleTimeout();
+
+    /**
+     * Handle the expiration of a period.
+     *
+     * @param missed the number of periods skipped since the previous
+     * call. It is always 0 with the CATCH_UP policy.
+     *
+     * @return if the timer should continue
+     */
+    virtual bool handlePeriod(unsigned long long missed) = 0;
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline PeriodicTimer::PeriodicTimer(nanos_t period, nanos_t phase,
+                                    policy_t policy) :
+    period(period),
+    phase(0),
+    policy(policy)
+{
+    assert(period>0);
+    this->phase = phase % period;
+}
+
+//------------------------------------------------------------------------------
+
+inline nanos_t PeriodicTimer::getPeriod() const
+{
+    return period;
+}
+
+//------------------------------------------------------------------------------
+
+inline nanos_t PeriodicTimer::getDeadline() const
+{
+    return timeout;
+}
+
+//------------------------------------------------------------------------------
+
+inline void PeriodicTimer::stop()
+{
+    cancel();
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_PERIODICTIMER_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,78 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+//------------------------------------------------------------------------------
+
+#include "RWLock.h"
+
+//------------------------------------------------------------------------------
+
+using lwt::RWLock;
+using lwt::Thread;
+
+//------------------------------------------------------------------------------
+
+bool RWLock::lockShared()
+{
+    return tryLockShared() || readerWaiters.wait();
+}
+
+//------------------------------------------------------------------------------
+
+void RWLock::unlockShared()
+{
+    assert(readers>0);
+    if (--readers==0) writer = writerWaiters.notifyOne();
+}
+
+//------------------------------------------------------------------------------
+
+bool RWLock::lock()
+{
+    if (tryLock()) return true;
+
+    if (writerWaiters.wait()) {
+        assert(writer==Thread::getCurrent());
+        return true;
+    }
+
+    // The readers may have been waiting only because of us
+    if (writer==0 && writerWaiters.isEmpty()) admitReaders();
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+void RWLock::unlock()
+{
+    assert(writer==Thread::getCurrent());
+    writer = 0;
+    if (readerWaiters.isEmpty()) {
+        writer = writerWaiters.notifyOne();
+    } else {
+        admitReaders();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,193 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_RWLOCK_H
+#define LWT_RWLOCK_H
+//------------------------------------------------------------------------------
+
+#include "WaitQueue.h"
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A readers-writer lock for the threads. It can be held by several
+ * readers or by a single writer. A new reader has to wait if a
+ * writer is waiting, so that the writers are not starved. When a
+ * writer unlocks the lock, all waiting readers are admitted at once,
+ * so the readers are not starved either. The lock is handed over to
+ * the threads woken up directly.
+ */
+class RWLock
+{
+private:
+    /**
+     * The number of readers holding the lock.
+     */
+    size_t readers;
+
+    /**
+     * The writer holding the lock, if any.
+     */
+    Thread* writer;
+
+    /**
+     * The waiting readers.
+     */
+    WaitQueue readerWaiters;
+
+    /**
+     * The waiting writers.
+     */
+    WaitQueue writerWaiters;
+
+public:
+    /**
+     * Construct the lock.
+     */
+    RWLock();
+
+    /**
+     * Destroy the lock. It should not be held.
+     */
+    ~RWLock();
+
+    /**
+     * Lock for reading.
+     *
+     * @return if the lock has been acquired. If not, errno is set to
+     * ETIMEDOUT or ECANCELED.
+     */
+    bool lockShared();
+
+    /**
+     * Lock for reading if possible without waiting.
+     */
+    bool tryLockShared();
+
+    /**
+     * Unlock after reading.
+     */
+    void unlockShared();
+
+    /**
+     * Lock for writing.
+     *
+     * @return if the lock has been acquired. If not, errno is set to
+     * ETIMEDOUT or ECANCELED.
+     */
+    bool lock();
+
+    /**
+     * Lock for writing if possible without waiting.
+     */
+    bool tryLock();
+
+    /**
+     * Unlock after writing.
+     */
+    void unlock();
+
+    /**
+     * Get the number of readers holding the lock.
+     */
+    size_t getNumReaders() const;
+
+    /**
+     * Get the writer holding the lock.
+     */
+    Thread* getWriter() const;
+
+private:
+    /**
+     * Admit all the waiting readers.
+     */
+    void admitReaders();
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline RWLock::RWLock() :
+    readers(0),
+    writer(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline RWLock::~RWLock()
+{
+    assert(readers==0 && writer==0);
+}
+
+//------------------------------------------------------------------------------
+
+inline bool RWLock::tryLockShared()
+{
+    if (writer!=0 || !writerWaiters.isEmpty()) return false;
+    ++readers;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool RWLock::tryLock()
+{
+    if (writer!=0 || readers>0) return false;
+    writer = Thread::getCurrent();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+inline size_t RWLock::getNumReaders() const
+{
+    return readers;
+}
+
+//------------------------------------------------------------------------------
+
+inline Thread* RWLock::getWriter() const
+{
+    return writer;
+}
+
+//------------------------------------------------------------------------------
+
+inline void RWLock::admitReaders()
+{
+    readers += readerWaiters.notifyAll();
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_RWLOCK_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -21,6 +21,7 @@
 
 #include "Scheduler.h"
 #include "Timer.h"
+#include "Clock.h"
 
 #include <cstdio>
 
@@ -36,21 +37,29 @@ Scheduler* Scheduler::instance = 0;
 
 void Scheduler::run()
 {
+    Clock::update();
+    Clock::setTicking(true);
+
     bool hadEvents = true;
     while(hadEvents) {
         if (saveContext(context)==0) {
             processReady();
         }
-
-        millis_t earliest = Timer::getEarliest();
-        int timeout = -1;
-        if (earliest!=INVALID_MILLIS) {
-            millis_t now = currentTimeMillis();
+        Thread::current = 0;
+
+        nanos_t earliest = Timer::getEarliest();
+        nanos_t timeout = INVALID_NANOS;
+        if (earliest!=INVALID_NANOS) {
+            // The cached time may be behind, if the threads have run
+            // for a long time, so it is refreshed before sleeping.
+            nanos_t now = Clock::now();
+            if (earliest>now) now = Clock::update();
             if (earliest<=now) timeout = 0;
             else timeout = earliest - now;
         }
 
-        int result = epoll->wait(hadEvents, timeout);
+        int result = epoll->waitNanos(hadEvents, timeout);
+        Clock::update();
         if (result<0) {
             assert(0 && "epoll failed");
         }
@@ -58,16 +67,29 @@ void Scheduler::run()
         hadEvents = Timer::handleTimeouts() || hadEvents;
         // printf("Scheduler::run1: hadEvents=%d\n", hadEvents);
     }
+
+    Clock::setTicking(false);
 }
 
 //------------------------------------------------------------------------------
 
 void Scheduler::processReady()
 {
-    if (readyFirst==0) return;
+    Thread* thread = runNext;
+    if (thread!=0 &&
+        (readyFirst==0 || runNextStreak<MAX_RUNNEXT_STREAK))
+    {
+        runNext = 0;
+        ++runNextStreak;
+    } else if (readyFirst!=0) {
+        thread = readyFirst;
+        thread->remove(readyFirst, readyLast);
+        runNextStreak = 0;
+    } else {
+        return;
+    }
 
-    Thread* thread = readyFirst;
-    thread->remove(readyFirst, readyLast);
+    prefetchContext(thread->context);
     Thread::current = thread;
     
     thread->resume();
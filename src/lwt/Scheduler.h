@@ -41,6 +41,14 @@ namespace lwt {
  */
 class Scheduler
 {
+public:
+    /**
+     * The maximal number of times in a row the run-next thread is
+     * preferred to the ready list. Without this limit, two threads
+     * waking up each other could starve the others.
+     */
+    static const unsigned MAX_RUNNEXT_STREAK = 16;
+
 private:
     /**
      * The only instance of the scheduler
@@ -74,6 +82,20 @@ private:
      */
     Thread* readyLast;
 
+    /**
+     * The thread most recently woken up by another thread. It is run
+     * before the threads in the ready list, so that it can use the
+     * data the waking thread has just produced while it is still in
+     * the cache.
+     */
+    Thread* runNext;
+
+    /**
+     * The number of times in a row the run-next thread has been
+     * preferred to the ready list.
+     */
+    unsigned runNextStreak;
+
     /**
      * The context of the scheduler.
      */
@@ -102,6 +124,19 @@ private:
      */
     void appendReady(Thread* thread);
 
+    /**
+     * Make the given thread ready after it has been unblocked. If it
+     * is woken up by another thread, it becomes the run-next thread,
+     * and the previous run-next thread, if any, is appended to the
+     * ready list. Otherwise it is appended to the ready list.
+     */
+    void wakeUp(Thread* thread);
+
+    /**
+     * Append the given circular list of threads to the ready list.
+     */
+    void appendReady(Thread* first, Thread* last);
+
     /**
      * Remove the given thread from the ready list if that thread is
      * in the ready list
@@ -126,6 +161,7 @@ private:
     void schedule();
 
     friend class Thread;
+    friend class WaitQueue;
 };
 
 //------------------------------------------------------------------------------
@@ -145,7 +181,9 @@ inline Scheduler::Scheduler(size_t stackSize, size_t stacksPerPool,
     stackManager(stackSize, stacksPerPool),
     epoll(epoll ? std::move(epoll) : std::make_unique<EPoll>()),
     readyFirst(0),
-    readyLast(0)
+    readyLast(0),
+    runNext(0),
+    runNextStreak(0)
 {
     assert(instance==0);
     instance = this;
@@ -157,6 +195,7 @@ inline Scheduler::~Scheduler()
 {
     assert(readyFirst==0);
     assert(readyLast==0);
+    assert(runNext==0);
     assert(instance==this);
     instance = 0;
 }
@@ -170,9 +209,38 @@ inline void Scheduler::appendReady(Thread* thread)
 
 //------------------------------------------------------------------------------
 
+inline void Scheduler::wakeUp(Thread* thread)
+{
+    if (Thread::current==0) {
+        appendReady(thread);
+    } else {
+        if (runNext!=0) appendReady(runNext);
+        runNext = thread;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline void Scheduler::appendReady(Thread* first, Thread* last)
+{
+    if (readyLast==0) {
+        readyFirst = first;
+    } else {
+        readyLast->next = first;
+        first->previous = readyLast;
+        last->next = readyFirst;
+        readyFirst->previous = last;
+    }
+    readyLast = last;
+}
+
+//------------------------------------------------------------------------------
+
 inline void Scheduler::removeReady(Thread* thread)
 {
-    if (thread->next!=0) {
+    if (thread==runNext) {
+        runNext = 0;
+    } else if (thread->next!=0) {
         thread->remove(readyFirst, readyLast);
     }
 }
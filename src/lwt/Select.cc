@@ -0,0 +1,272 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+//------------------------------------------------------------------------------
+
+#include "Select.h"
+
+#include <cerrno>
+
+//------------------------------------------------------------------------------
+
+using lwt::SelectCase;
+using lwt::Selector;
+using lwt::TimerCase;
+using lwt::JoinCase;
+using lwt::FutureCase;
+using lwt::PromiseBase;
+using lwt::BlockedThread;
+
+//------------------------------------------------------------------------------
+
+void SelectCase::fireAll(SelectCase*& head)
+{
+    while (head!=0) head->fire();
+}
+
+//------------------------------------------------------------------------------
+
+SelectCase::SelectCase(Selector& selector) :
+    selector(selector),
+    nextCase(0),
+    nextInSource(0),
+    sourceLink(0),
+    fired(false)
+{
+    selector.add(this);
+}
+
+//------------------------------------------------------------------------------
+
+SelectCase::~SelectCase()
+{
+    unlink();
+    selector.remove(this);
+}
+
+//------------------------------------------------------------------------------
+
+void SelectCase::link(SelectCase*& head)
+{
+    assert(sourceLink==0);
+    nextInSource = head;
+    if (head!=0) head->sourceLink = &nextInSource;
+    head = this;
+    sourceLink = &head;
+}
+
+//------------------------------------------------------------------------------
+
+void SelectCase::unlink()
+{
+    if (sourceLink==0) return;
+
+    *sourceLink = nextInSource;
+    if (nextInSource!=0) nextInSource->sourceLink = sourceLink;
+    nextInSource = 0;
+    sourceLink = 0;
+}
+
+//------------------------------------------------------------------------------
+
+void SelectCase::fire()
+{
+    unlink();
+    fired = true;
+    if (selector.blocker.isBlocked()) selector.blocker.unblock();
+}
+
+//------------------------------------------------------------------------------
+
+bool SelectCase::poll()
+{
+    return fired;
+}
+
+//------------------------------------------------------------------------------
+
+void SelectCase::detach()
+{
+    unlink();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+SelectCase* Selector::wait()
+{
+    for(SelectCase* c = firstCase; c!=0; c = c->nextCase) {
+        c->fired = false;
+    }
+
+    while(true) {
+        SelectCase* ready = poll();
+        if (ready!=0) return ready;
+
+        for(SelectCase* c = firstCase; c!=0; c = c->nextCase) {
+            c->attach();
+        }
+
+        BlockedThread::result_t result = blocker.blockCurrent();
+
+        for(SelectCase* c = firstCase; c!=0; c = c->nextCase) {
+            c->detach();
+        }
+
+        if (result!=BlockedThread::UNBLOCKED) {
+            errno = (result==BlockedThread::TIMEDOUT) ? ETIMEDOUT : ECANCELED;
+            return 0;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Selector::add(SelectCase* c)
+{
+    SelectCase** link = &firstCase;
+    while (*link!=0) link = &((*link)->nextCase);
+    *link = c;
+}
+
+//------------------------------------------------------------------------------
+
+void Selector::remove(SelectCase* c)
+{
+    SelectCase** link = &firstCase;
+    while (*link!=c) link = &((*link)->nextCase);
+    *link = c->nextCase;
+    c->nextCase = 0;
+}
+
+//------------------------------------------------------------------------------
+
+SelectCase* Selector::poll()
+{
+    for(SelectCase* c = firstCase; c!=0; c = c->nextCase) {
+        if (c->poll()) return c;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool TimerCase::CaseTimer::handleTimeout()
+{
+    timerCase.fire();
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+bool TimerCase::poll()
+{
+    return deadline<=Clock::now();
+}
+
+//------------------------------------------------------------------------------
+
+void TimerCase::attach()
+{
+    if (deadline!=INVALID_NANOS) timer.schedule(deadline);
+}
+
+//------------------------------------------------------------------------------
+
+void TimerCase::detach()
+{
+    timer.cancel();
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void JoinCase::threadDeleted(JoinCase*& head)
+{
+    while (head!=0) {
+        JoinCase* joinCase = head;
+        head = joinCase->nextOfThread;
+        joinCase->thread = 0;
+        joinCase->nextOfThread = 0;
+        joinCase->threadLink = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+JoinCase::~JoinCase()
+{
+    if (threadLink!=0) {
+        *threadLink = nextOfThread;
+        if (nextOfThread!=0) nextOfThread->threadLink = threadLink;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+bool JoinCase::poll()
+{
+    return hasFired() || thread==0 || thread->isFinished();
+}
+
+//------------------------------------------------------------------------------
+
+void JoinCase::attach()
+{
+    // poll() returns true if the thread is gone, so the case is not
+    // attached in that case
+    if (thread!=0) thread->selectJoin(*this);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+void FutureCase::Listener::handleCompletion(PromiseBase& /*promise*/)
+{
+    futureCase.fire();
+}
+
+//------------------------------------------------------------------------------
+
+bool FutureCase::poll()
+{
+    return future.isReady();
+}
+
+//------------------------------------------------------------------------------
+
+void FutureCase::attach()
+{
+    future.then(listener);
+}
+
+//------------------------------------------------------------------------------
+
+void FutureCase::detach()
+{
+    listener.unregister();
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
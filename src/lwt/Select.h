@@ -0,0 +1,608 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_SELECT_H
+#define LWT_SELECT_H
+//------------------------------------------------------------------------------
+
+#include "SelectCase.h"
+#include "BlockedThread.h"
+#include "Thread.h"
+#include "Timer.h"
+#include "Clock.h"
+#include "Future.h"
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A selector to wait for any of several events in the current
+ * thread. The events are represented by cases (subclasses of
+ * SelectCase) constructed for the selector, for example:
+ *
+ * Selector selector;
+ * ReadCase<ThreadedFD> fromClient(selector, clientFD);
+ * ReadCase<ThreadedFD> fromServer(selector, serverFD);
+ * TimerCase idle(selector, Clock::now() + idleTimeout);
+ *
+ * SelectCase* c = selector.wait();
+ *
+ * The selector and its cases should be used by one thread.
+ */
+class Selector
+{
+private:
+    /**
+     * The first case.
+     */
+    SelectCase* firstCase;
+
+    /**
+     * The blocked thread reference of the waiting thread.
+     */
+    BlockedThread blocker;
+
+public:
+    /**
+     * Construct the selector.
+     */
+    Selector();
+
+    /**
+     * Destroy the selector. All its cases should have been destroyed.
+     */
+    ~Selector();
+
+private:
+    Selector(const Selector&);
+    Selector& operator=(const Selector&);
+
+public:
+    /**
+     * Wait for any of the cases. If several cases are ready, the one
+     * constructed first is returned. When the function returns, the
+     * cases are deregistered from all their sources.
+     *
+     * @return the case that is ready, or 0 if the waiting has timed
+     * out or has been cancelled (errno is set to ETIMEDOUT or
+     * ECANCELED). A thread deadline set by Thread::DeadlineScope
+     * applies here as well.
+     */
+    SelectCase* wait();
+
+private:
+    /**
+     * Add the given case.
+     */
+    void add(SelectCase* c);
+
+    /**
+     * Remove the given case.
+     */
+    void remove(SelectCase* c);
+
+    /**
+     * Return the first case that is ready, if any.
+     */
+    SelectCase* poll();
+
+    friend class SelectCase;
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A case for a file descriptor becoming readable. FD can be any
+ * threaded file descriptor type (see ThreadedFDMixin). The case
+ * fires also if the file descriptor is closed or destroyed, so the
+ * file descriptor should be checked before reading.
+ */
+template <class FD>
+class ReadCase : public SelectCase
+{
+private:
+    /**
+     * The file descriptor.
+     */
+    FD& fd;
+
+public:
+    /**
+     * Construct the case.
+     */
+    ReadCase(Selector& selector, FD& fd);
+
+protected:
+    /**
+     * Register at the file descriptor.
+     */
+    virtual void attach();
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A case for a file descriptor becoming writable.
+ */
+template <class FD>
+class WriteCase : public SelectCase
+{
+private:
+    /**
+     * The file descriptor.
+     */
+    FD& fd;
+
+public:
+    /**
+     * Construct the case.
+     */
+    WriteCase(Selector& selector, FD& fd);
+
+protected:
+    /**
+     * Register at the file descriptor.
+     */
+    virtual void attach();
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A case for a deadline.
+ */
+class TimerCase : public SelectCase
+{
+private:
+    /**
+     * The timer firing the case.
+     */
+    class CaseTimer : public Timer
+    {
+    private:
+        /**
+         * The case.
+         */
+        TimerCase& timerCase;
+
+    public:
+        /**
+         * Construct the timer.
+         */
+        CaseTimer(TimerCase& timerCase);
+
+    protected:
+        /**
+         * Fire the case.
+         */
+        virtual bool handleTimeout();
+    };
+
+    /**
+     * The deadline.
+     */
+    nanos_t deadline;
+
+    /**
+     * The timer.
+     */
+    CaseTimer timer;
+
+public:
+    /**
+     * Construct the case for the given deadline on the monotonic
+     * clock. If it is INVALID_NANOS, the case never fires.
+     */
+    TimerCase(Selector& selector, nanos_t deadline);
+
+    /**
+     * Get the deadline.
+     */
+    nanos_t getDeadline() const;
+
+    /**
+     * Set the deadline.
+     */
+    void setDeadline(nanos_t d);
+
+protected:
+    /**
+     * Determine if the deadline has passed.
+     */
+    virtual bool poll();
+
+    /**
+     * Schedule the timer.
+     */
+    virtual void attach();
+
+    /**
+     * Cancel the timer.
+     */
+    virtual void detach();
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A case for a joinable thread finishing. It fires also if the thread
+ * is deleted. The case is registered at the thread as long as either
+ * of them exists, so it can outlive the thread: once the thread is
+ * deleted, the case is always ready.
+ */
+class JoinCase : public SelectCase
+{
+private:
+    /**
+     * The thread, or 0 if it has been deleted.
+     */
+    Thread* thread;
+
+    /**
+     * The next case constructed for the same thread.
+     */
+    JoinCase* nextOfThread;
+
+    /**
+     * The pointer pointing to us in the list of the cases of the
+     * thread.
+     */
+    JoinCase** threadLink;
+
+public:
+    /**
+     * Clear the thread of the cases in the list with the given head,
+     * since the thread is being deleted.
+     */
+    static void threadDeleted(JoinCase*& head);
+
+    /**
+     * Construct the case.
+     */
+    JoinCase(Selector& selector, Thread& thread);
+
+    /**
+     * Destroy the case by removing it from the list of its thread.
+     */
+    virtual ~JoinCase();
+
+protected:
+    /**
+     * Determine if the thread has finished.
+     */
+    virtual bool poll();
+
+    /**
+     * Register at the thread.
+     */
+    virtual void attach();
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A case for a future becoming ready.
+ */
+class FutureCase : public SelectCase
+{
+private:
+    /**
+     * The listener of the promise.
+     */
+    class Listener : public PromiseBase::Listener
+    {
+    private:
+        /**
+         * The case.
+         */
+        FutureCase& futureCase;
+
+    public:
+        /**
+         * Construct the listener.
+         */
+        Listener(FutureCase& futureCase);
+
+    protected:
+        /**
+         * Fire the case.
+         */
+        virtual void handleCompletion(PromiseBase& promise);
+    };
+
+    /**
+     * The future.
+     */
+    FutureBase& future;
+
+    /**
+     * The listener.
+     */
+    Listener listener;
+
+public:
+    /**
+     * Construct the case.
+     */
+    FutureCase(Selector& selector, FutureBase& future);
+
+protected:
+    /**
+     * Determine if the future is ready.
+     */
+    virtual bool poll();
+
+    /**
+     * Register the listener.
+     */
+    virtual void attach();
+
+    /**
+     * Unregister the listener.
+     */
+    virtual void detach();
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A case for a channel having a value to receive, or being closed.
+ * C can be any Channel type.
+ */
+template <class C>
+class ReceiveCase : public SelectCase
+{
+private:
+    /**
+     * The channel.
+     */
+    C& channel;
+
+public:
+    /**
+     * Construct the case.
+     */
+    ReceiveCase(Selector& selector, C& channel);
+
+protected:
+    /**
+     * Determine if a value can be received.
+     */
+    virtual bool poll();
+
+    /**
+     * Register at the channel.
+     */
+    virtual void attach();
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A case for a channel having space for a value, or being closed. C
+ * can be any Channel type.
+ */
+template <class C>
+class SendCase : public SelectCase
+{
+private:
+    /**
+     * The channel.
+     */
+    C& channel;
+
+public:
+    /**
+     * Construct the case.
+     */
+    SendCase(Selector& selector, C& channel);
+
+protected:
+    /**
+     * Determine if a value can be sent.
+     */
+    virtual bool poll();
+
+    /**
+     * Register at the channel.
+     */
+    virtual void attach();
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline Selector::Selector() :
+    firstCase(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline Selector::~Selector()
+{
+    assert(firstCase==0);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <class FD>
+inline ReadCase<FD>::ReadCase(Selector& selector, FD& fd) :
+    SelectCase(selector),
+    fd(fd)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <class FD>
+void ReadCase<FD>::attach()
+{
+    fd.selectRead(*this);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <class FD>
+inline WriteCase<FD>::WriteCase(Selector& selector, FD& fd) :
+    SelectCase(selector),
+    fd(fd)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <class FD>
+void WriteCase<FD>::attach()
+{
+    fd.selectWrite(*this);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline TimerCase::CaseTimer::CaseTimer(TimerCase& timerCase) :
+    timerCase(timerCase)
+{
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline TimerCase::TimerCase(Selector& selector, nanos_t deadline) :
+    SelectCase(selector),
+    deadline(deadline),
+    timer(*this)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline nanos_t TimerCase::getDeadline() const
+{
+    return deadline;
+}
+
+//------------------------------------------------------------------------------
+
+inline void TimerCase::setDeadline(nanos_t d)
+{
+    deadline = d;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline JoinCase::JoinCase(Selector& selector, Thread& thread) :
+    SelectCase(selector),
+    thread(&thread),
+    nextOfThread(thread.joinCaseList),
+    threadLink(&thread.joinCaseList)
+{
+    if (nextOfThread!=0) nextOfThread->threadLink = &nextOfThread;
+    thread.joinCaseList = this;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline FutureCase::Listener::Listener(FutureCase& futureCase) :
+    futureCase(futureCase)
+{
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline FutureCase::FutureCase(Selector& selector, FutureBase& future) :
+    SelectCase(selector),
+    future(future),
+    listener(*this)
+{
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <class C>
+inline ReceiveCase<C>::ReceiveCase(Selector& selector, C& channel) :
+    SelectCase(selector),
+    channel(channel)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <class C>
+bool ReceiveCase<C>::poll()
+{
+    return channel.size()>0 || channel.isClosed();
+}
+
+//------------------------------------------------------------------------------
+
+template <class C>
+void ReceiveCase<C>::attach()
+{
+    channel.selectReceive(*this);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <class C>
+inline SendCase<C>::SendCase(Selector& selector, C& channel) :
+    SelectCase(selector),
+    channel(channel)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <class C>
+bool SendCase<C>::poll()
+{
+    return channel.size()<C::capacity() || channel.isClosed();
+}
+
+//------------------------------------------------------------------------------
+
+template <class C>
+void SendCase<C>::attach()
+{
+    channel.selectSend(*this);
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_SELECT_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
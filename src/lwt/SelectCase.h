@@ -0,0 +1,155 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_SELECTCASE_H
+#define LWT_SELECTCASE_H
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+class Selector;
+
+//------------------------------------------------------------------------------
+
+/**
+ * A case of a selector, i.e. a source of events the selector waits
+ * for. While the selector waits, the case is registered at its
+ * source (e.g. a threaded file descriptor), which fires the case when
+ * the event occurs. Firing removes the case from the source.
+ *
+ * The sources keep their cases in an intrusive singly linked list,
+ * whose head is a SelectCase pointer in the source.
+ */
+class SelectCase
+{
+private:
+    /**
+     * The selector.
+     */
+    Selector& selector;
+
+    /**
+     * The next case of the selector.
+     */
+    SelectCase* nextCase;
+
+    /**
+     * The next case in the list of the source.
+     */
+    SelectCase* nextInSource;
+
+    /**
+     * The pointer pointing to us in the list of the source, or 0 if
+     * we are not registered at a source.
+     */
+    SelectCase** sourceLink;
+
+    /**
+     * Indicate if the case has been fired since the selector started
+     * waiting.
+     */
+    bool fired;
+
+public:
+    /**
+     * Fire all cases in the list with the given head.
+     */
+    static void fireAll(SelectCase*& head);
+
+protected:
+    /**
+     * Construct the case for the given selector.
+     */
+    SelectCase(Selector& selector);
+
+    /**
+     * Destroy the case by removing it from its source and selector.
+     */
+    virtual ~SelectCase();
+
+private:
+    SelectCase(const SelectCase&);
+    SelectCase& operator=(const SelectCase&);
+
+public:
+    /**
+     * Register the case in the list of a source with the given head.
+     */
+    void link(SelectCase*& head);
+
+    /**
+     * Remove the case from the list of its source, if it is there.
+     */
+    void unlink();
+
+    /**
+     * Fire the case. It is removed from its source, and the selector
+     * is woken up.
+     */
+    void fire();
+
+    /**
+     * Determine if the case has fired.
+     */
+    bool hasFired() const;
+
+protected:
+    /**
+     * Determine if the event of the case has occured, without
+     * blocking. The default implementation returns whether the case
+     * has been fired.
+     */
+    virtual bool poll();
+
+    /**
+     * Register the case at its source.
+     */
+    virtual void attach() = 0;
+
+    /**
+     * Deregister the case from its source. The default implementation
+     * unlinks the case.
+     */
+    virtual void detach();
+
+    friend class Selector;
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline bool SelectCase::hasFired() const
+{
+    return fired;
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_SELECTCASE_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,130 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_SEMAPHORE_H
+#define LWT_SEMAPHORE_H
+//------------------------------------------------------------------------------
+
+#include "WaitQueue.h"
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A counting semaphore for the threads. A released permit is handed
+ * over to the first waiting thread directly, if there is any.
+ */
+class Semaphore
+{
+private:
+    /**
+     * The number of permits available.
+     */
+    size_t permits;
+
+    /**
+     * The threads waiting for a permit.
+     */
+    WaitQueue waiters;
+
+public:
+    /**
+     * Construct the semaphore with the given number of permits.
+     */
+    Semaphore(size_t permits = 0);
+
+    /**
+     * Acquire a permit, waiting for one if none is available.
+     *
+     * @return if a permit has been acquired. If not, errno is set to
+     * ETIMEDOUT or ECANCELED.
+     */
+    bool acquire();
+
+    /**
+     * Acquire a permit, if one is available.
+     *
+     * @return if a permit has been acquired.
+     */
+    bool tryAcquire();
+
+    /**
+     * Release a permit.
+     */
+    void release();
+
+    /**
+     * Get the number of permits available.
+     */
+    size_t getPermits() const;
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline Semaphore::Semaphore(size_t permits) :
+    permits(permits)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline bool Semaphore::acquire()
+{
+    return tryAcquire() || waiters.wait();
+}
+
+//------------------------------------------------------------------------------
+
+inline bool Semaphore::tryAcquire()
+{
+    if (permits==0) return false;
+    --permits;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+inline void Semaphore::release()
+{
+    if (waiters.notifyOne()==0) ++permits;
+}
+
+//------------------------------------------------------------------------------
+
+inline size_t Semaphore::getPermits() const
+{
+    return permits;
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_SEMAPHORE_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
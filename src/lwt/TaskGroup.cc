@@ -0,0 +1,177 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+//------------------------------------------------------------------------------
+
+#include "TaskGroup.h"
+
+//------------------------------------------------------------------------------
+
+using lwt::TaskGroup;
+using lwt::BlockedThread;
+using lwt::Thread;
+
+//------------------------------------------------------------------------------
+
+TaskGroup::Task::~Task()
+{
+    group.remove(this);
+}
+
+//------------------------------------------------------------------------------
+
+void TaskGroup::Task::run()
+{
+    if (!execute()) group.fail(errno==0 ? ECANCELED : errno);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+bool TaskGroup::DeadlineTimer::handleTimeout()
+{
+    group.fail(ETIMEDOUT);
+    return false;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+TaskGroup::TaskGroup(size_t maxRunning, nanos_t deadline) :
+    firstTask(0),
+    numRunning(0),
+    maxRunning(maxRunning),
+    failed(false),
+    error(0),
+    deadlineTimer(*this)
+{
+    if (deadline!=INVALID_NANOS) deadlineTimer.schedule(deadline);
+}
+
+//------------------------------------------------------------------------------
+
+TaskGroup::~TaskGroup()
+{
+    if (numRunning>0) {
+        fail(ECANCELED);
+
+        Thread::UninterruptibleScope uninterruptibleScope;
+        while (numRunning>0) waiter.blockCurrent();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+bool TaskGroup::join()
+{
+    while (numRunning>0) {
+        BlockedThread::result_t result = waiter.blockCurrent();
+        if (result!=BlockedThread::UNBLOCKED) {
+            fail(result==BlockedThread::TIMEDOUT ? ETIMEDOUT : ECANCELED);
+
+            Thread::UninterruptibleScope uninterruptibleScope;
+            while (numRunning>0) waiter.blockCurrent();
+        }
+    }
+
+    deadlineTimer.cancel();
+
+    if (failed) {
+        errno = error;
+        return false;
+    } else {
+        return true;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void TaskGroup::cancel()
+{
+    fail(ECANCELED);
+}
+
+//------------------------------------------------------------------------------
+
+bool TaskGroup::waitSlot()
+{
+    while (!failed && maxRunning>0 && numRunning>=maxRunning) {
+        BlockedThread::result_t result = waiter.blockCurrent();
+        if (result!=BlockedThread::UNBLOCKED) {
+            fail(result==BlockedThread::TIMEDOUT ? ETIMEDOUT : ECANCELED);
+        }
+    }
+
+    if (failed) {
+        errno = error;
+        return false;
+    } else {
+        return true;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void TaskGroup::fail(int e)
+{
+    if (failed) return;
+
+    failed = true;
+    error = e;
+    deadlineTimer.cancel();
+
+    for(Task* task = firstTask; task!=0; task = task->nextTask) {
+        task->cancel();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void TaskGroup::add(Task* task)
+{
+    task->nextTask = firstTask;
+    if (firstTask!=0) firstTask->previousTask = task;
+    firstTask = task;
+    ++numRunning;
+
+    if (failed) task->cancel();
+}
+
+//------------------------------------------------------------------------------
+
+void TaskGroup::remove(Task* task)
+{
+    if (task->previousTask==0) {
+        firstTask = task->nextTask;
+    } else {
+        task->previousTask->nextTask = task->nextTask;
+    }
+    if (task->nextTask!=0) task->nextTask->previousTask = task->previousTask;
+    task->nextTask = task->previousTask = 0;
+
+    --numRunning;
+    waiter.unblock();
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,329 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_TASKGROUP_H
+#define LWT_TASKGROUP_H
+//------------------------------------------------------------------------------
+
+#include "BlockedThread.h"
+#include "Thread.h"
+#include "Timer.h"
+
+#include <cerrno>
+#include <utility>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A group of child threads (tasks) owned by a parent thread. The
+ * parent spawns the tasks via the group, and waits for all of them
+ * with a single block in join(). If a task fails or the deadline of
+ * the group expires, the remaining tasks are cancelled. The number
+ * of concurrently running tasks can be bounded, in which case
+ * spawn() waits for a task to finish before starting a new one.
+ *
+ * The group is meant to be allocated in the frame of the parent
+ * thread. Only the parent should call the member functions of the
+ * group (except for cancel()). The destructor cancels the tasks
+ * still running and waits for them, so no task outlives the group.
+ */
+class TaskGroup
+{
+public:
+    /**
+     * The base class of the tasks. A task is a detached thread that
+     * is deleted when it finishes.
+     */
+    class Task : public Thread
+    {
+    private:
+        /**
+         * The group the task belongs to.
+         */
+        TaskGroup& group;
+
+        /**
+         * The next task in the group.
+         */
+        Task* nextTask;
+
+        /**
+         * The previous task in the group.
+         */
+        Task* previousTask;
+
+    protected:
+        /**
+         * Construct the task in the given group.
+         */
+        Task(TaskGroup& group);
+
+        /**
+         * Destroy the task by removing it from the group.
+         */
+        virtual ~Task();
+
+        /**
+         * Get the group of the task.
+         */
+        TaskGroup& getGroup() const;
+
+        /**
+         * Perform the operation of the task.
+         *
+         * @return if the task has succeeded. If not, errno should
+         * contain the error code, and the other tasks of the group
+         * will be cancelled.
+         */
+        virtual bool execute() = 0;
+
+    private:
+        /**
+         * Call execute() and report a failure to the group.
+         */
+        virtual void run();
+
+        friend class TaskGroup;
+    };
+
+private:
+    /**
+     * The timer implementing the deadline of the group.
+     */
+    class DeadlineTimer : public Timer
+    {
+    private:
+        /**
+         * The group.
+         */
+        TaskGroup& group;
+
+    public:
+        /**
+         * Construct the timer for the given group.
+         */
+        DeadlineTimer(TaskGroup& group);
+
+    protected:
+        /**
+         * Fail the group with ETIMEDOUT.
+         */
+        virtual bool handleTimeout();
+    };
+
+    /**
+     * The first task of the group.
+     */
+    Task* firstTask;
+
+    /**
+     * The number of tasks running.
+     */
+    size_t numRunning;
+
+    /**
+     * The maximal number of tasks running concurrently, or 0 if
+     * there is no limit.
+     */
+    size_t maxRunning;
+
+    /**
+     * Indicate if the group has failed.
+     */
+    bool failed;
+
+    /**
+     * The error code of the failure.
+     */
+    int error;
+
+    /**
+     * The reference of the parent thread, when it waits for a task
+     * to finish.
+     */
+    BlockedThread waiter;
+
+    /**
+     * The deadline timer.
+     */
+    DeadlineTimer deadlineTimer;
+
+public:
+    /**
+     * Construct the group.
+     *
+     * @param maxRunning the maximal number of concurrently running
+     * tasks, or 0 if there is no limit.
+     * @param deadline the deadline of the group on the monotonic
+     * clock, or INVALID_NANOS if there is none. When it expires, the
+     * tasks are cancelled, and the group fails with ETIMEDOUT.
+     */
+    TaskGroup(size_t maxRunning = 0, nanos_t deadline = INVALID_NANOS);
+
+    /**
+     * Destroy the group. The tasks still running are cancelled, and
+     * the group waits for them to finish.
+     */
+    ~TaskGroup();
+
+private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+public:
+    /**
+     * Spawn a task of type T, which is constructed with the group and
+     * the given arguments. If the number of running tasks has reached
+     * the limit, wait for one to finish first.
+     *
+     * @return the task, or 0 if the group has failed (errno is set to
+     * its error code) or the waiting has timed out or been cancelled
+     * (errno is set to ETIMEDOUT or ECANCELED). In the latter case
+     * the tasks of the group are cancelled too.
+     */
+    template <class T, typename... Args> T* spawn(Args&&... args);
+
+    /**
+     * Wait for all tasks to finish. If the waiting thread's deadline
+     * expires or it is cancelled, the tasks are cancelled, and
+     * waited for without interruption.
+     *
+     * @return if the tasks have all succeeded. If not, errno is set
+     * to the error code of the group.
+     */
+    bool join();
+
+    /**
+     * Cancel the tasks of the group. The group fails with ECANCELED,
+     * unless it has failed already.
+     */
+    void cancel();
+
+    /**
+     * Get the number of tasks running.
+     */
+    size_t getNumRunning() const;
+
+    /**
+     * Determine if the group has failed.
+     */
+    bool hasFailed() const;
+
+    /**
+     * Get the error code of the group's failure.
+     */
+    int getError() const;
+
+private:
+    /**
+     * Wait for a slot for a new task.
+     *
+     * @return if a new task can be started.
+     */
+    bool waitSlot();
+
+    /**
+     * Fail the group with the given error code, and cancel the
+     * tasks, unless the group has failed already.
+     */
+    void fail(int e);
+
+    /**
+     * Add the given task to the group.
+     */
+    void add(Task* task);
+
+    /**
+     * Remove the given task from the group.
+     */
+    void remove(Task* task);
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline TaskGroup::Task::Task(TaskGroup& group) :
+    group(group),
+    nextTask(0),
+    previousTask(0)
+{
+    group.add(this);
+}
+
+//------------------------------------------------------------------------------
+
+inline TaskGroup& TaskGroup::Task::getGroup() const
+{
+    return group;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline TaskGroup::DeadlineTimer::DeadlineTimer(TaskGroup& group) :
+    group(group)
+{
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+template <class T, typename... Args> T* TaskGroup::spawn(Args&&... args)
+{
+    if (!waitSlot()) return 0;
+    return new T(*this, std::forward<Args>(args)...);
+}
+
+//------------------------------------------------------------------------------
+
+inline size_t TaskGroup::getNumRunning() const
+{
+    return numRunning;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool TaskGroup::hasFailed() const
+{
+    return failed;
+}
+
+//------------------------------------------------------------------------------
+
+inline int TaskGroup::getError() const
+{
+    return error;
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_TASKGROUP_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -24,17 +24,76 @@
 
 #include "Scheduler.h"
 #include "StackManager.h"
+#include "Timer.h"
+#include "Clock.h"
+#include "WaitQueue.h"
+#include "Select.h"
 
 #include <cstdio>
 
 //------------------------------------------------------------------------------
 
 using lwt::Thread;
+using lwt::BlockedThread;
 using lwt::Scheduler;
+using lwt::WaitQueue;
+using lwt::SelectCase;
+using lwt::JoinCase;
 using lwt::Context;
 
 //------------------------------------------------------------------------------
 
+namespace {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A timer that unblocks a blocked thread reference with the TIMEDOUT
+ * result, when the deadline of the blocked thread expires.
+ */
+class DeadlineTimer : public lwt::Timer
+{
+private:
+    /**
+     * The blocked thread reference.
+     */
+    BlockedThread* blocker;
+
+public:
+    /**
+     * Construct the timer for the given reference.
+     */
+    DeadlineTimer(BlockedThread* blocker);
+
+protected:
+    /**
+     * Unblock the thread.
+     */
+    virtual bool handleTimeout();
+};
+
+//------------------------------------------------------------------------------
+
+inline DeadlineTimer::DeadlineTimer(BlockedThread* blocker) :
+    blocker(blocker)
+{
+}
+
+//------------------------------------------------------------------------------
+
+bool DeadlineTimer::handleTimeout()
+{
+    if (blocker->isBlocked()) blocker->unblock(BlockedThread::TIMEDOUT);
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+} /* anonymous namespace */
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
 Thread* Thread::current = 0;
 
 //------------------------------------------------------------------------------
@@ -53,10 +112,34 @@ inline void Thread::schedule()
 
 //------------------------------------------------------------------------------
 
-void Thread::block(BlockedThread* blocker)
+void Thread::block(BlockedThread* blocker, WaitQueue* queue)
+{
+    nanos_t deadline = current->deadline;
+    if (current->uninterruptible>0) {
+        suspend(blocker, queue);
+    } else if (current->cancelled) {
+        blocker->result = BlockedThread::CANCELLED;
+    } else if (deadline==INVALID_NANOS) {
+        suspend(blocker, queue);
+    } else if (deadline<=Clock::now()) {
+        blocker->result = BlockedThread::TIMEDOUT;
+    } else {
+        DeadlineTimer timer(blocker);
+        timer.setSlack(current->deadlineSlack);
+        timer.schedule(deadline);
+        current->deadlineTimer = &timer;
+        suspend(blocker, queue);
+        current->deadlineTimer = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Thread::suspend(BlockedThread* blocker, WaitQueue* queue)
 {
     current->blocker = blocker;
     blocker->setThread(current);
+    if (queue!=0) queue->add(current);
     if (saveContext(current->context)==0) {
         schedule();
     }
@@ -72,10 +155,9 @@ extern "C" void startThread(Thread* thread, Context& callerContext)
     } else {
         thread->run();
         if (thread->joinable) {
-            if (thread->joiner->isBlocked()) {
-                thread->finished = true;
-                thread->joiner->unblock();
-            }
+            thread->finished = true;
+            thread->joiner->unblock();
+            SelectCase::fireAll(thread->joinCases);
         } else {
             delete thread;
         }
@@ -93,7 +175,16 @@ Thread::Thread(bool joinable) :
     blocker(0),
     finished(false),
     joiner(joinable ? new BlockedThread() : 0),
-    joined(0)
+    joined(0),
+    waitQueue(0),
+    joinCases(0),
+    joinCaseList(0),
+    sleepTimer(0),
+    deadlineTimer(0),
+    deadline(INVALID_NANOS),
+    deadlineSlack(0),
+    uninterruptible(0),
+    cancelled(false)
 {
     char buf[32];
     snprintf(buf, sizeof(buf), "Thread[%p]", this);
@@ -128,13 +219,21 @@ Thread::~Thread()
 
     delete joiner;
 
+    // The wait queues share the links with the ready list
+    if (waitQueue!=0) waitQueue->remove(this);
     Scheduler::get().removeReady(this);
+    SelectCase::fireAll(joinCases);
+    JoinCase::threadDeleted(joinCaseList);
     
     if (blocker!=0) {
         blocker->clearThread();
         blocker = 0;
     }
 
+    // The timers on the stack should not stay in the wheel
+    if (sleepTimer!=0) sleepTimer->cancel();
+    if (deadlineTimer!=0) deadlineTimer->cancel();
+
     StackManager::get().releaseStack(stackTop);
 
     if (current==this) current = 0;
@@ -149,10 +248,28 @@ bool Thread::join()
     if (finished) return true;
 
     current->joined = this;        
-    joiner->blockCurrent();
+    BlockedThread::result_t result = joiner->blockCurrent();
     current->joined = 0;
     
-    return true;
+    return result==BlockedThread::UNBLOCKED;
+}
+
+//------------------------------------------------------------------------------
+
+void Thread::selectJoin(SelectCase& c)
+{
+    assert(joinable);
+    c.link(joinCases);
+}
+
+//------------------------------------------------------------------------------
+
+void Thread::cancel()
+{
+    cancelled = true;
+    if (blocker!=0 && uninterruptible==0) {
+        blocker->cancel();
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -162,7 +279,8 @@ void Thread::unblock()
     assert(blocker!=0);
     blocker->clearThread();
     blocker = 0;
-    appendReady();
+    if (waitQueue!=0) waitQueue->remove(this);
+    Scheduler::get().wakeUp(this);
 }
 
 //------------------------------------------------------------------------------
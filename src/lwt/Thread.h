@@ -22,6 +22,7 @@
 //------------------------------------------------------------------------------
 
 #include "Context.h"
+#include "util.h"
 
 #include <string>
 
@@ -40,6 +41,10 @@ namespace lwt {
 //------------------------------------------------------------------------------
 
 class BlockedThread;
+class WaitQueue;
+class SelectCase;
+class JoinCase;
+class Timer;
 
 //------------------------------------------------------------------------------
 
@@ -48,6 +53,66 @@ class BlockedThread;
  */
 class Thread
 {
+public:
+    /**
+     * A scope within which the blocking operations of the current
+     * thread time out at the given deadline. If the current thread
+     * already has an earlier deadline, that remains in effect. The
+     * previous deadline is restored when the scope ends. A blocking
+     * operation that times out returns the TIMEDOUT result from
+     * BlockedThread::blockCurrent(), and the I/O functions return
+     * an error with errno set to ETIMEDOUT.
+     */
+    class DeadlineScope
+    {
+    private:
+        /**
+         * The deadline that was in effect before this scope.
+         */
+        nanos_t previousDeadline;
+
+        /**
+         * The slack of the deadline that was in effect before this
+         * scope.
+         */
+        nanos_t previousDeadlineSlack;
+
+    public:
+        /**
+         * Construct the scope with the given deadline, which is a
+         * time of the monotonic clock (see Clock). The operations may
+         * time out at any time between the deadline and the deadline
+         * plus the given slack (see Timer). By default, they time
+         * out as close to the deadline as the timers allow.
+         */
+        DeadlineScope(nanos_t deadline, nanos_t slack = 0);
+
+        /**
+         * Destroy the scope by restoring the previous deadline.
+         */
+        ~DeadlineScope();
+    };
+
+    /**
+     * A scope within which the blocking operations of the current
+     * thread are not affected by the thread's deadline or
+     * cancellation. It is meant for waits that cannot be abandoned
+     * safely.
+     */
+    class UninterruptibleScope
+    {
+    public:
+        /**
+         * Construct the scope.
+         */
+        UninterruptibleScope();
+
+        /**
+         * Destroy the scope.
+         */
+        ~UninterruptibleScope();
+    };
+
 private:
     /**
      * Schedule the execution of the next thread or the scheduler.
@@ -67,9 +132,11 @@ public:
 
 private:
     /**
-     * Block the current thread with the given blocked thread reference.
+     * Block the current thread with the given blocked thread
+     * reference. If a wait queue is given, the thread is appended to
+     * it while it is blocked.
      */
-    static void block(BlockedThread* blocker);
+    static void block(BlockedThread* blocker, WaitQueue* queue = 0);
 
 private:
     /**
@@ -119,6 +186,59 @@ private:
      * The thread we are joining if any.
      */
     Thread* joined;
+
+    /**
+     * The wait queue the thread is waiting in, if any. While in a
+     * wait queue, the thread is linked into it via the next and
+     * previous members.
+     */
+    WaitQueue* waitQueue;
+
+    /**
+     * The select cases waiting for the thread to finish.
+     */
+    SelectCase* joinCases;
+
+    /**
+     * All join cases constructed for the thread, so that they can be
+     * told when the thread is deleted.
+     */
+    JoinCase* joinCaseList;
+
+    /**
+     * The timer on the stack of the thread that it is sleeping on,
+     * if any. It is cancelled if the thread is deleted while sleeping,
+     * since the stack is released.
+     */
+    Timer* sleepTimer;
+
+    /**
+     * The timer on the stack of the thread that expires at its
+     * deadline while it is blocked, if any. It is cancelled if the
+     * thread is deleted while blocked.
+     */
+    Timer* deadlineTimer;
+
+    /**
+     * The deadline of the blocking operations of the thread, or
+     * INVALID_NANOS if there is none.
+     */
+    nanos_t deadline;
+
+    /**
+     * The slack of the deadline.
+     */
+    nanos_t deadlineSlack;
+
+    /**
+     * The number of uninterruptible scopes the thread is in.
+     */
+    unsigned uninterruptible;
+
+    /**
+     * Indicate if the thread has been cancelled.
+     */
+    bool cancelled;
     
     /**
      * The log context. Defaults to Thread[<address>].
@@ -157,13 +277,51 @@ public:
      *
      * @return if the joining was successul. If it is not successful
      * that means that this thread been deleted while it was being
-     * joined. 
+     * joined, or the joining thread's deadline has expired.
      */
     bool join();
 
+    /**
+     * Determine if the execution of a joinable thread has finished.
+     */
+    bool isFinished() const;
+
+    /**
+     * Register the given select case to be fired when the thread
+     * finishes or is deleted. The thread should be joinable.
+     */
+    void selectJoin(SelectCase& c);
+
+    /**
+     * Get the deadline of the blocking operations of the thread.
+     */
+    nanos_t getDeadline() const;
+
+    /**
+     * Cancel the thread. If the thread is blocked, it is unblocked
+     * with the CANCELLED result, whatever it is waiting for (I/O, a
+     * timer, a join, etc.). The cancellation is sticky: any further
+     * blocking operation of the thread fails at once with the
+     * CANCELLED result, so the thread should finish its work as soon
+     * as possible. Uninterruptible waits are not affected.
+     */
+    void cancel();
+
+    /**
+     * Determine if the thread has been cancelled.
+     */
+    bool isCancelled() const;
+
 private:
     /**
-     * Unblock the thread
+     * Suspend the current thread on the given blocked thread
+     * reference and wait queue, and schedule another thread.
+     */
+    static void suspend(BlockedThread* blocker, WaitQueue* queue);
+
+    /**
+     * Unblock the thread. If it is in a wait queue, it is removed
+     * from there.
      */
     void unblock();
 
@@ -201,6 +359,9 @@ private:
     friend void ::startThread(Thread*, lwt::Context&);
     friend class Scheduler;
     friend class BlockedThread;
+    friend class WaitQueue;
+    friend class JoinCase;
+    friend class Timer;
     friend class Log;
 };
 
@@ -222,6 +383,64 @@ inline void Thread::setLogContext(const std::string& context)
 
 //------------------------------------------------------------------------------
 
+inline bool Thread::isFinished() const
+{
+    return finished;
+}
+
+//------------------------------------------------------------------------------
+
+inline nanos_t Thread::getDeadline() const
+{
+    return deadline;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool Thread::isCancelled() const
+{
+    return cancelled;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline Thread::DeadlineScope::DeadlineScope(nanos_t deadline,
+                                             nanos_t slack) :
+    previousDeadline(current->deadline),
+    previousDeadlineSlack(current->deadlineSlack)
+{
+    if (deadline<current->deadline) {
+        current->deadline = deadline;
+        current->deadlineSlack = slack;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline Thread::DeadlineScope::~DeadlineScope()
+{
+    current->deadline = previousDeadline;
+    current->deadlineSlack = previousDeadlineSlack;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+inline Thread::UninterruptibleScope::UninterruptibleScope()
+{
+    ++current->uninterruptible;
+}
+
+//------------------------------------------------------------------------------
+
+inline Thread::UninterruptibleScope::~UninterruptibleScope()
+{
+    --current->uninterruptible;
+}
+
+//------------------------------------------------------------------------------
+
 inline void Thread::resume()
 {
     restoreContext(context, 1);
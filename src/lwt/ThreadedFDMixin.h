@@ -22,6 +22,7 @@
 //------------------------------------------------------------------------------
 
 #include "BlockedThread.h"
+#include "SelectCase.h"
 
 #include <cerrno>
 
@@ -36,6 +37,11 @@ namespace lwt {
 /**
  * A mixin for the polled file descriptor that can be used to wait for
  * the file descriptor becoming readable or writable.
+ *
+ * The blocking functions obey the deadline of the current thread
+ * (see Thread::DeadlineScope). If the deadline expires, they fail
+ * with errno set to ETIMEDOUT. If the waiting is cancelled, errno is
+ * set to ECANCELED.
  */
 template <class Super>
 class ThreadedFDMixin : public Super
@@ -51,6 +57,16 @@ protected:
      */
     BlockedThread writeWaiter;
 
+    /**
+     * The select cases waiting for an EPOLLIN
+     */
+    SelectCase* readCases;
+
+    /**
+     * The select cases waiting for an EPOLLOUT
+     */
+    SelectCase* writeCases;
+
 protected:
     /**
      * Construct a threaded file descriptor for the given file
@@ -58,6 +74,12 @@ protected:
      */
     ThreadedFDMixin(int fd);
 
+    /**
+     * Destroy the file descriptor. The select cases waiting for it
+     * are fired.
+     */
+    virtual ~ThreadedFDMixin();
+
 public:
     /**
      * Cancel a reading, if one is in progress.
@@ -73,6 +95,18 @@ public:
      */
     bool cancelWrite();
 
+    /**
+     * Register the given select case to be fired when the file
+     * descriptor becomes readable.
+     */
+    void selectRead(SelectCase& c);
+
+    /**
+     * Register the given select case to be fired when the file
+     * descriptor becomes writable.
+     */
+    void selectWrite(SelectCase& c);
+
     /**
      * Read from the file descriptor. It blocks until data is
      * available (or an error occurs).
@@ -94,7 +128,8 @@ public:
     bool writeAll(const void* buf, size_t count);
 
     /**
-     * Close the file descriptor. It unblocks any waiters.
+     * Close the file descriptor. It unblocks any waiters, and fires
+     * the select cases.
      */
     int close();
 
@@ -112,6 +147,13 @@ protected:
      */
     virtual int updateEvents(uint32_t& events);
 
+    /**
+     * Set errno according to the given result of a blocking.
+     *
+     * @return if the result indicates a normal unblocking
+     */
+    static bool checkResult(BlockedThread::result_t result);
+
     /**
      * Wait for the file descriptor becoming readable
      *
@@ -132,8 +174,18 @@ protected:
 //------------------------------------------------------------------------------
 
 template <class Super> inline ThreadedFDMixin<Super>::ThreadedFDMixin(int fd) :
-    Super(fd)
+    Super(fd),
+    readCases(0),
+    writeCases(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+template <class Super> ThreadedFDMixin<Super>::~ThreadedFDMixin()
 {
+    SelectCase::fireAll(readCases);
+    SelectCase::fireAll(writeCases);
 }
 
 //------------------------------------------------------------------------------
@@ -152,6 +204,22 @@ template <class Super> inline bool ThreadedFDMixin<Super>::cancelWrite()
 
 //------------------------------------------------------------------------------
 
+template <class Super>
+inline void ThreadedFDMixin<Super>::selectRead(SelectCase& c)
+{
+    c.link(readCases);
+}
+
+//------------------------------------------------------------------------------
+
+template <class Super>
+inline void ThreadedFDMixin<Super>::selectWrite(SelectCase& c)
+{
+    c.link(writeCases);
+}
+
+//------------------------------------------------------------------------------
+
 template <class Super> ssize_t
 ThreadedFDMixin<Super>::read(void* buf, size_t count)
 {
@@ -204,6 +272,8 @@ template <class Super> inline int ThreadedFDMixin<Super>::close()
     if (a==0) {
         readWaiter.unblock();
         writeWaiter.unblock();
+        SelectCase::fireAll(readCases);
+        SelectCase::fireAll(writeCases);
     }
 
     return a;
@@ -214,11 +284,13 @@ template <class Super> inline int ThreadedFDMixin<Super>::close()
 template <class Super>
 void ThreadedFDMixin<Super>::handleEvents(uint32_t events)
 {
-    if (readWaiter.isBlocked() && (events&(EPOLLIN|EPOLLHUP|EPOLLERR))!=0) {
-        readWaiter.unblock();
+    if ((events&(EPOLLIN|EPOLLHUP|EPOLLERR))!=0) {
+        if (readWaiter.isBlocked()) readWaiter.unblock();
+        SelectCase::fireAll(readCases);
     }
-    if (writeWaiter.isBlocked() && (events&(EPOLLOUT|EPOLLHUP|EPOLLERR))!=0) {
-        writeWaiter.unblock();
+    if ((events&(EPOLLOUT|EPOLLHUP|EPOLLERR))!=0) {
+        if (writeWaiter.isBlocked()) writeWaiter.unblock();
+        SelectCase::fireAll(writeCases);
     }
 }
 
@@ -228,24 +300,45 @@ template <class Super>
 int ThreadedFDMixin<Super>::updateEvents(uint32_t& events)
 {
     Super::requestedEvents = 0;
-    if (readWaiter.isBlocked()) Super::requestedEvents |= EPOLLIN;
-    if (writeWaiter.isBlocked()) Super::requestedEvents |= EPOLLOUT;
+    if (readWaiter.isBlocked() || readCases!=0) {
+        Super::requestedEvents |= EPOLLIN;
+    }
+    if (writeWaiter.isBlocked() || writeCases!=0) {
+        Super::requestedEvents |= EPOLLOUT;
+    }
 
     return Super::updateEvents(events);
 }
 
 //------------------------------------------------------------------------------
 
+template <class Super> inline bool
+ThreadedFDMixin<Super>::checkResult(BlockedThread::result_t result)
+{
+    switch(result) {
+      case BlockedThread::UNBLOCKED:
+        return true;
+      case BlockedThread::TIMEDOUT:
+        errno = ETIMEDOUT;
+        return false;
+      default:
+        errno = ECANCELED;
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------------
+
 template <class Super> inline bool ThreadedFDMixin<Super>::waitRead()
 {
-    return readWaiter.blockCurrent()==BlockedThread::UNBLOCKED;
+    return checkResult(readWaiter.blockCurrent());
 }
 
 //------------------------------------------------------------------------------
 
 template <class Super> inline bool ThreadedFDMixin<Super>::waitWrite()
 {
-    return writeWaiter.blockCurrent()==BlockedThread::UNBLOCKED;
+    return checkResult(writeWaiter.blockCurrent());
 }
 
 //------------------------------------------------------------------------------
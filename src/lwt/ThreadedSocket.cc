@@ -59,7 +59,7 @@ ssize_t ThreadedSocket::recv(void* buf, size_t len, int flags)
     while(true) {
         ssize_t result = Socket::recv(buf, len, flags);
         if (result<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) {
-            if (!waitRead()) return 0;
+            if (!waitRead()) return (errno==ETIMEDOUT) ? -1 : 0;
         } else {
             return result;
         }
@@ -73,7 +73,7 @@ ssize_t ThreadedSocket::send(const void* buf, size_t len, int flags)
     while(true) {
         ssize_t result = Socket::send(buf, len, flags);
         if (result<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) {
-            if (!waitWrite()) return 0;
+            if (!waitWrite()) return (errno==ETIMEDOUT) ? -1 : 0;
         } else {
             return result;
         }
@@ -64,12 +64,16 @@ public:
     int connect(const struct sockaddr* addr, socklen_t addrlen);
 
     /**
-     * Receive some data into the given buffer
+     * Receive some data into the given buffer. If the waiting is
+     * cancelled, 0 is returned. If the deadline of the thread
+     * expires, -1 is returned with errno set to ETIMEDOUT.
      */
     ssize_t recv(void* buf, size_t len, int flags = 0);
 
     /**
-     * Send some data on the socket
+     * Send some data on the socket. If the waiting is cancelled, 0
+     * is returned. If the deadline of the thread expires, -1 is
+     * returned with errno set to ETIMEDOUT.
      */
     ssize_t send(const void* buf, size_t len, int flags = 0);
 
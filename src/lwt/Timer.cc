@@ -21,6 +21,12 @@
 
 #include "Timer.h"
 #include "BlockedThread.h"
+#include "Clock.h"
+#include "Thread.h"
+
+#include <cassert>
+
+#include <inttypes.h>
 
 //------------------------------------------------------------------------------
 
@@ -34,8 +40,9 @@ namespace {
 //------------------------------------------------------------------------------
 
 /**
- * A timer that blocks the current thread on creation, and unblocks
- * the process on expiration
+ * A timer that can block the current thread, and unblocks the
+ * thread on expiration. It is meant to be put on the stack of the
+ * thread being blocked.
  */
 class BlockerTimer : public lwt::Timer
 {
@@ -47,10 +54,10 @@ private:
 
 public:
     /**
-     * Construct the timer with the given timeout and block the
-     * current process.
+     * Schedule the timer with the given timeout and block the
+     * current thread until it expires.
      */
-    BlockerTimer(millis_t timeout);
+    void block(nanos_t timeout);
     
 protected:
     /**
@@ -61,10 +68,11 @@ protected:
 
 //------------------------------------------------------------------------------
 
-BlockerTimer::BlockerTimer(millis_t timeout) :
-    Timer(timeout)
+void BlockerTimer::block(nanos_t timeout)
 {
+    schedule(timeout);
     thread.blockCurrent();
+    cancel();
 }
     
 //------------------------------------------------------------------------------
@@ -82,54 +90,507 @@ bool BlockerTimer::handleTimeout()
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-Timer::timers_t Timer::timers;
+/**
+ * A hierarchical timing wheel. Each level consists of SIZE slots,
+ * each slot being a circular list of the timers. Within the wheel
+ * time is measured in ticks of 2^TICK_BITS nanoseconds. A slot of
+ * level 0 covers one tick, and a slot of each further level covers
+ * as much time as the whole previous level. A timer is put into the
+ * lowest level whose range covers its timeout. When the wheel
+ * reaches the start of a slot on a higher level, the timers of that
+ * slot are cascaded, i.e. re-inserted into the lower levels. The
+ * timers of a level 0 slot expire when the wheel reaches that slot.
+ *
+ * Insertion and removal take constant time. A bitmap of the
+ * occupied slots is maintained for each level, so that empty parts
+ * of the wheel can be skipped quickly.
+ *
+ * The expiration time of a timer is chosen from the interval
+ * allowed by its slack so that it has as many trailing zero bits as
+ * possible. Thus timers with similar timeouts and enough slack are
+ * aligned to the same time, and expire together.
+ *
+ * For each slot a lower bound of the expiration times of its timers
+ * is also maintained. The scheduler needs to wake up only at the
+ * earliest such bound, the cascades due before it can be performed
+ * late.
+ */
+class Timer::Wheel
+{
+private:
+    /**
+     * The number of bits of a nanosecond value that are below the
+     * resolution of the wheel. A tick is about 4 microseconds.
+     */
+    static const unsigned TICK_BITS = 12;
+
+    /**
+     * The number of bits of the slot index in each level.
+     */
+    static const unsigned BITS = 6;
+
+    /**
+     * The number of slots in each level.
+     */
+    static const unsigned SIZE = 1<<BITS;
+
+    /**
+     * Mask for the slot index.
+     */
+    static const unsigned MASK = SIZE - 1;
+
+    /**
+     * The number of levels. Timers farther than what the levels
+     * cover are put into the last slot, and will be cascaded
+     * repeatedly until they get into range.
+     */
+    static const unsigned LEVELS = 6;
+
+    /**
+     * The largest distance from the current time in ticks that the
+     * wheel can represent.
+     */
+    static const nanos_t MAX_DELTA = (static_cast<nanos_t>(1)<<(BITS*LEVELS)) - 1;
+
+    /**
+     * Rotate the given bitmap to the right by the given number of
+     * bits.
+     */
+    static uint64_t rotate(uint64_t bits, unsigned count);
+
+    /**
+     * Get the expiration time of the given timer in ticks. It is the
+     * time between its timeout and its timeout plus slack that has
+     * the most trailing zero bits, rounded up to a whole tick.
+     */
+    static nanos_t getExpiration(const Timer* timer);
+
+    /**
+     * Link the given timer to the end of the list with the given
+     * head.
+     */
+    static void link(Timer*& first, Timer* timer);
+
+    /**
+     * Unlink the given timer from the list with the given head.
+     */
+    static void unlink(Timer*& first, Timer* timer);
+
+    /**
+     * The slots.
+     */
+    Timer* slots[LEVELS][SIZE];
+
+    /**
+     * The lower bounds of the expiration times of the timers in the
+     * slots in ticks. It is INVALID_NANOS for an empty slot.
+     */
+    nanos_t minimums[LEVELS][SIZE];
+
+    /**
+     * The bitmaps of the occupied slots.
+     */
+    uint64_t occupied[LEVELS];
+
+    /**
+     * The list of the timers being expired. Timers are moved here
+     * from their slot before their handlers are called, so that the
+     * handlers may cancel or re-insert any timer safely.
+     */
+    Timer* expiring;
+
+    /**
+     * The next tick to be processed by the wheel.
+     */
+    nanos_t current;
+
+    /**
+     * The number of timers in the wheel.
+     */
+    size_t count;
+
+public:
+    /**
+     * Construct the wheel.
+     */
+    Wheel();
+
+    /**
+     * Insert the given timer.
+     */
+    void insert(Timer* timer);
+
+    /**
+     * Remove the given timer.
+     */
+    void remove(Timer* timer);
+
+    /**
+     * Get the earliest time the wheel should be advanced to, so
+     * that no timer expires late, or INVALID_NANOS if the wheel is
+     * empty.
+     */
+    nanos_t getEarliest() const;
+
+    /**
+     * Advance the wheel up to and including the given time. The
+     * handlers of the expired timers are called.
+     *
+     * @return if any timers have expired
+     */
+    bool advance(nanos_t now);
+
+    /**
+     * Determine if the wheel is empty.
+     */
+    bool empty() const;
+
+private:
+    /**
+     * Get the tick of the first occupied slot of the given level,
+     * i.e. the tick when it should be cascaded or, for level 0,
+     * expired. The index of the slot is also returned. The level
+     * should not be empty.
+     */
+    nanos_t getFirstSlot(unsigned level, unsigned& index) const;
+
+    /**
+     * Get the tick of the next event of the wheel: either an
+     * expiration or a cascade, or INVALID_NANOS if the wheel is
+     * empty.
+     */
+    nanos_t getNextEvent() const;
+
+    /**
+     * Clear the given slot of the given level.
+     */
+    void clearSlot(unsigned level, unsigned index);
+
+    /**
+     * Cascade the slot of the given level that corresponds to the
+     * current time.
+     *
+     * @return the index of the slot
+     */
+    unsigned cascade(unsigned level);
+};
+
+//------------------------------------------------------------------------------
+
+inline uint64_t Timer::Wheel::rotate(uint64_t bits, unsigned count)
+{
+    return (count==0) ? bits : ((bits>>count) | (bits<<(SIZE-count)));
+}
+
+//------------------------------------------------------------------------------
+
+inline nanos_t Timer::Wheel::getExpiration(const Timer* timer)
+{
+    nanos_t timeout = timer->timeout;
+    nanos_t limit = timeout + timer->slack;
+    if (limit<timeout) limit = INVALID_NANOS - 1;
+
+    nanos_t mask = timeout ^ limit;
+    if (mask!=0) {
+        mask = (static_cast<nanos_t>(1)<<(63 - __builtin_clzll(mask))) - 1;
+        limit &= ~mask;
+    }
+
+    nanos_t ticks = limit>>TICK_BITS;
+    if ((limit & ((static_cast<nanos_t>(1)<<TICK_BITS) - 1))!=0) ++ticks;
+    return ticks;
+}
 
 //------------------------------------------------------------------------------
 
-bool Timer::handleTimeouts()
+inline void Timer::Wheel::link(Timer*& first, Timer* timer)
+{
+    if (first==0) {
+        timer->next = timer->previous = timer;
+        first = timer;
+    } else {
+        Timer* last = first->previous;
+        timer->previous = last;
+        timer->next = first;
+        last->next = timer;
+        first->previous = timer;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+inline void Timer::Wheel::unlink(Timer*& first, Timer* timer)
+{
+    if (timer->next==timer) {
+        first = 0;
+    } else {
+        timer->previous->next = timer->next;
+        timer->next->previous = timer->previous;
+        if (first==timer) first = timer->next;
+    }
+    timer->next = timer->previous = 0;
+}
+
+//------------------------------------------------------------------------------
+
+Timer::Wheel::Wheel() :
+    expiring(0),
+    current(currentTimeNanos()>>TICK_BITS),
+    count(0)
+{
+    for(unsigned level = 0; level<LEVELS; ++level) {
+        for(unsigned index = 0; index<SIZE; ++index) {
+            slots[level][index] = 0;
+            minimums[level][index] = INVALID_NANOS;
+        }
+        occupied[level] = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Timer::Wheel::insert(Timer* timer)
+{
+    assert(timer->slot==0);
+
+    nanos_t expiration = getExpiration(timer);
+    nanos_t expires = (expiration<current) ? current : expiration;
+    nanos_t delta = expires - current;
+    if (delta>MAX_DELTA) {
+        delta = MAX_DELTA;
+        expires = current + MAX_DELTA;
+    }
+
+    unsigned level = 0;
+    while((delta>>(BITS*(level+1)))!=0) ++level;
+
+    unsigned index = (expires>>(BITS*level)) & MASK;
+
+    Timer*& first = slots[level][index];
+    link(first, timer);
+    timer->slot = &first;
+    occupied[level] |= static_cast<uint64_t>(1)<<index;
+    if (expiration<minimums[level][index]) minimums[level][index] = expiration;
+    ++count;
+}
+
+//------------------------------------------------------------------------------
+
+void Timer::Wheel::remove(Timer* timer)
+{
+    assert(timer->slot!=0);
+
+    Timer*& first = *timer->slot;
+    unlink(first, timer);
+    if (first==0 && timer->slot!=&expiring) {
+        size_t offset = timer->slot - &slots[0][0];
+        clearSlot(offset/SIZE, offset%SIZE);
+    }
+    timer->slot = 0;
+    --count;
+}
+
+//------------------------------------------------------------------------------
+
+nanos_t Timer::Wheel::getEarliest() const
 {
-    static const millis_t tolerance = 5;
+    nanos_t earliest = INVALID_NANOS;
+    for(unsigned level = 0; level<LEVELS; ++level) {
+        if (occupied[level]==0) continue;
+
+        unsigned index = 0;
+        nanos_t t = getFirstSlot(level, index);
+        if (minimums[level][index]>t) t = minimums[level][index];
+        if (t<earliest) earliest = t;
+    }
+    return (earliest==INVALID_NANOS) ? INVALID_NANOS : (earliest<<TICK_BITS);
+}
 
+//------------------------------------------------------------------------------
+
+bool Timer::Wheel::advance(nanos_t now)
+{
     bool hadTimeouts = false;
 
-    millis_t t = currentTimeMillis()+tolerance;
-    while(!timers.empty()) {
-        timers_t::iterator i = timers.begin();        
-        Timer* timer = *i;
+    now >>= TICK_BITS;
+
+    while(count>0) {
+        nanos_t next = getNextEvent();
+        if (next>now) break;
+
+        current = next;
+        if ((current & MASK)==0) {
+            for(unsigned level = 1; level<LEVELS && cascade(level)==0;
+                ++level) ;
+        }
+
+        Timer*& first = slots[0][current & MASK];
+        if (first!=0) {
+            expiring = first;
+            for(Timer* timer = first->next; timer!=first; timer = timer->next) {
+                timer->slot = &expiring;
+            }
+            first->slot = &expiring;
+            first = 0;
+            clearSlot(0, current & MASK);
+        }
+
+        ++current;
 
-        if (timer->timeout <= t) {
-            timers.erase(i);
+        while(expiring!=0) {
+            Timer* timer = expiring;
+            remove(timer);
             hadTimeouts = true;
+            // An embedded timer may be destroyed with its owner by
+            // the handler, so it should not be accessed afterwards
+            bool autoDelete = timer->autoDelete;
             if (timer->handleTimeout()) {
-                timers.insert(timer);
-            } else {
+                if (!timer->isPending()) insert(timer);
+            } else if (autoDelete) {
                 delete timer;
             }
-        } else {
-            break;
         }
     }
 
-    return hadTimeouts || !timers.empty();
+    if (current<=now) current = now + 1;
+
+    return hadTimeouts;
+}
+
+//------------------------------------------------------------------------------
+
+inline bool Timer::Wheel::empty() const
+{
+    return count==0;
+}
+
+//------------------------------------------------------------------------------
+
+inline nanos_t Timer::Wheel::getFirstSlot(unsigned level,
+                                           unsigned& index) const
+{
+    // If the current time is at the start of a slot of this
+    // level, that slot has not been cascaded yet, so it is to
+    // be considered. Otherwise the slot of the current time
+    // contains timers for the next round only.
+    unsigned shift = BITS*level;
+    nanos_t position = current>>shift;
+    unsigned currentIndex = position & MASK;
+    bool aligned = (current & ((static_cast<nanos_t>(1)<<shift) - 1))==0;
+    unsigned start = aligned ? currentIndex : (currentIndex+1);
+
+    nanos_t distance =
+        __builtin_ctzll(rotate(occupied[level], start & MASK)) +
+        (aligned ? 0 : 1);
+
+    index = (currentIndex + distance) & MASK;
+    return (position + distance)<<shift;
+}
+
+//------------------------------------------------------------------------------
+
+nanos_t Timer::Wheel::getNextEvent() const
+{
+    nanos_t next = INVALID_NANOS;
+    for(unsigned level = 0; level<LEVELS; ++level) {
+        if (occupied[level]==0) continue;
+
+        unsigned index = 0;
+        nanos_t t = getFirstSlot(level, index);
+        if (t<next) next = t;
+    }
+    return next;
+}
+
+//------------------------------------------------------------------------------
+
+inline void Timer::Wheel::clearSlot(unsigned level, unsigned index)
+{
+    occupied[level] &= ~(static_cast<uint64_t>(1)<<index);
+    minimums[level][index] = INVALID_NANOS;
+}
+
+//------------------------------------------------------------------------------
+
+unsigned Timer::Wheel::cascade(unsigned level)
+{
+    unsigned index = (current>>(BITS*level)) & MASK;
+
+    Timer* first = slots[level][index];
+    slots[level][index] = 0;
+    clearSlot(level, index);
+
+    while(first!=0) {
+        Timer* timer = first;
+        unlink(first, timer);
+        timer->slot = 0;
+        --count;
+        insert(timer);
+    }
+
+    return index;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+Timer::Wheel Timer::wheel;
+
+//------------------------------------------------------------------------------
+
+nanos_t Timer::getEarliest()
+{
+    return wheel.getEarliest();
+}
+
+//------------------------------------------------------------------------------
+
+bool Timer::handleTimeouts()
+{
+    bool hadTimeouts = wheel.advance(Clock::now());
+
+    return hadTimeouts || !wheel.empty();
 }
 
 //------------------------------------------------------------------------------
 
 void Timer::sleep(millis_t ms)
 {
-    new BlockerTimer(currentTimeMillis() + ms);
+    sleepNanos(ms*NANOS_PER_MILLI);
+}
+
+//------------------------------------------------------------------------------
+
+void Timer::sleepNanos(nanos_t ns, nanos_t slack)
+{
+    sleepUntil(Clock::now() + ns, slack);
+}
+
+//------------------------------------------------------------------------------
+
+void Timer::sleepUntil(nanos_t timeout, nanos_t slack)
+{
+    Thread* thread = Thread::getCurrent();
+
+    BlockerTimer timer;
+    timer.setSlack(slack);
+    thread->sleepTimer = &timer;
+    timer.block(timeout);
+    thread->sleepTimer = 0;
 }
 
 //------------------------------------------------------------------------------
 
 void Timer::cancel()
 {
-    for(timers_t::iterator i = timers.lower_bound(this); i!=timers.end(); ++i) {
-        if (*i==this) {
-            timers.erase(i);
-            return;
-        }
-    }    
+    if (slot!=0) wheel.remove(this);
+}
+
+//------------------------------------------------------------------------------
+
+void Timer::insert()
+{
+    wheel.insert(this);
 }
 
 //------------------------------------------------------------------------------
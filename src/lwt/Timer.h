@@ -23,8 +23,6 @@
 
 #include "util.h"
 
-#include <set>
-
 //------------------------------------------------------------------------------
 
 namespace lwt {
@@ -32,35 +30,68 @@ namespace lwt {
 //------------------------------------------------------------------------------
 
 /**
- * Timer
+ * Timer. The times of the timers are in nanoseconds, as returned by
+ * currentTimeNanos() or Clock::now(), i.e. they are measured on the
+ * monotonic clock. The relative sleep functions count from the
+ * cached time of Clock.
+ *
+ * A timer can be created in two ways. If it is constructed
+ * with a timeout, it is inserted into the wheel at once, and it
+ * will be deleted by the timer subsystem once it has expired and is
+ * not reused. Such timers should be allocated with new. If it is
+ * constructed without a timeout, it can be embedded in its owner
+ * object or put on the stack of a thread. It is not pending until
+ * schedule() is called, and it is never deleted by the timer
+ * subsystem. It is removed from the wheel when destroyed.
+ *
+ * Each timer has a slack: it may expire at any time between its
+ * timeout and the timeout plus the slack. Timers with a large slack
+ * are aligned to common boundaries, so that they expire in batches
+ * requiring a single wakeup of the scheduler.
  */
 class Timer
 {
-private:
+public:
     /**
-     * Less class for the timer
+     * The default slack of the timers in nanoseconds.
      */
-    struct Less
+    static const nanos_t DEFAULT_SLACK = 5*NANOS_PER_MILLI;
+
+    /**
+     * A time of the monotonic clock in nanoseconds, for the
+     * constructor scheduling the timer at once. The constructor
+     * used to take milliseconds, so the timeout should be wrapped
+     * explicitly, e.g. Timer(Timer::At(Clock::now() + delay)). This
+     * way, an old call passing milliseconds does not compile.
+     */
+    struct At
     {
-        bool operator()(const Timer* timer1, const Timer* timer2) const;
+        /// The time
+        nanos_t timeout;
+
+        /// Construct the time
+        explicit At(nanos_t timeout) : timeout(timeout) {}
     };
 
+private:
     /**
-     * Type for the set of timers
+     * The timing wheel holding the pending timers.
      */
-    typedef std::multiset<Timer*, Less> timers_t;
+    class Wheel;
 
     /**
-     * The set of timers
+     * The wheel of timers
      */
-    static timers_t timers;
+    static Wheel wheel;
 
 public:
     /**
-     * Get the earliest timeout or INVALID_MILLIS, if there is no
-     * timer
+     * Get the earliest time at which the timers need attention or
+     * INVALID_NANOS, if there is no timer. It may be earlier than
+     * the earliest timeout, if some timers must be moved to a finer
+     * level of the wheel before they expire.
      */
-    static millis_t getEarliest();
+    static nanos_t getEarliest();
 
     /**
      * Handle the timeouts. 
@@ -71,74 +102,186 @@ public:
     static bool handleTimeouts();
 
     /**
-     * Sleep the given number of milliseconds.
+     * Sleep the given number of milliseconds. It does not allocate
+     * any memory.
      */
     static void sleep(millis_t ms);
+
+    /**
+     * Sleep the given number of nanoseconds with the given slack.
+     */
+    static void sleepNanos(nanos_t ns, nanos_t slack = DEFAULT_SLACK);
+
+    /**
+     * Sleep until the given time with the given slack.
+     */
+    static void sleepUntil(nanos_t timeout, nanos_t slack = DEFAULT_SLACK);
     
 protected:
     /**
      * The timeout
      */
-    millis_t timeout;
+    nanos_t timeout;
+
+    /**
+     * The slack, i.e. the amount of time the timer may expire later
+     * than its timeout.
+     */
+    nanos_t slack;
+
+private:
+    /**
+     * The next timer in the wheel slot containing this timer.
+     */
+    Timer* next;
+
+    /**
+     * The previous timer in the wheel slot containing this timer.
+     */
+    Timer* previous;
+
+    /**
+     * The head of the wheel slot containing this timer, or 0 if the
+     * timer is not pending.
+     */
+    Timer** slot;
+
+    /**
+     * Indicate if the timer should be deleted by the timer subsystem
+     * after expiring.
+     */
+    bool autoDelete;
 
 public:
     /**
      * Construct the timer with the given timeout. It will be added to
-     * the set of timers.
+     * the wheel of timers, and deleted when it expires and is not
+     * reused.
+     */
+    Timer(At at);
+
+    /**
+     * Construct a timer that is not pending yet. It will never be
+     * deleted by the timer subsystem.
      */
-    Timer(millis_t timeout);
+    Timer();
 
     /**
-     * Destroy the timer. It will not be removed from the set, it
-     * should be removed separately.
+     * Destroy the timer. If it is pending, it will be removed from
+     * the wheel.
      */
     virtual ~Timer();
 
     /**
-     * Cancel this timer. It will be removed from the set.
+     * Determine if the timer is pending, i.e. it is in the wheel.
+     */
+    bool isPending() const;
+
+    /**
+     * Schedule the timer to expire at the given time. If it is
+     * pending, it will be rescheduled.
+     */
+    void schedule(nanos_t timeout);
+
+    /**
+     * Cancel this timer. It will be removed from the wheel in
+     * constant time.
      */
     void cancel();
 
+    /**
+     * Get the slack of the timer.
+     */
+    nanos_t getSlack() const;
+
+    /**
+     * Set the slack of the timer. If the timer is pending, it takes
+     * effect only when it is scheduled again.
+     */
+    void setSlack(nanos_t s);
+
 protected:
     /**
      * Handle the timeout. The timer should be removed before this
      * function is called.
      *
      * @return if the timer should be reused. If so, it will be put
-     * back to the set of timers, with a (hopefully) new timeout set
-     * by this function. Otherwise it will be deleted.
+     * back to the wheel of timers, with a (hopefully) new timeout set
+     * by this function, unless the function has rescheduled the
+     * timer itself. Otherwise it will be deleted, if it was
+     * constructed with a timeout.
      */
     virtual bool handleTimeout() = 0;
+
+private:
+    /**
+     * Insert this timer into the wheel.
+     */
+    void insert();
 };
 
 //------------------------------------------------------------------------------
 // Inline definitions
 //------------------------------------------------------------------------------
 
-inline bool Timer::Less::operator()(const Timer* timer1, const Timer* timer2) const
+inline Timer::Timer(At at) :
+    timeout(at.timeout),
+    slack(DEFAULT_SLACK),
+    next(0),
+    previous(0),
+    slot(0),
+    autoDelete(true)
 {
-    return timer1->timeout < timer2->timeout;
+    insert();
 }
 
 //------------------------------------------------------------------------------
 
-inline millis_t Timer::getEarliest()
+inline Timer::Timer() :
+    timeout(INVALID_NANOS),
+    slack(DEFAULT_SLACK),
+    next(0),
+    previous(0),
+    slot(0),
+    autoDelete(false)
 {
-    return timers.empty() ? INVALID_MILLIS : (*timers.begin())->timeout;
 }
 
 //------------------------------------------------------------------------------
 
-inline Timer::Timer(millis_t timeout) :
-    timeout(timeout)
+inline Timer::~Timer()
 {
-    timers.insert(this);
+    cancel();
 }
 
 //------------------------------------------------------------------------------
 
-inline Timer::~Timer()
+inline bool Timer::isPending() const
+{
+    return slot!=0;
+}
+
+//------------------------------------------------------------------------------
+
+inline void Timer::schedule(nanos_t timeout)
+{
+    cancel();
+    this->timeout = timeout;
+    insert();
+}
+
+//------------------------------------------------------------------------------
+
+inline nanos_t Timer::getSlack() const
+{
+    return slack;
+}
+
+//------------------------------------------------------------------------------
+
+inline void Timer::setSlack(nanos_t s)
 {
+    slack = s;
 }
 
 //------------------------------------------------------------------------------
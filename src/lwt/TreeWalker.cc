@@ -0,0 +1,240 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+//------------------------------------------------------------------------------
+
+#include "TreeWalker.h"
+
+#include "Dirent.h"
+#include "FileSystem.h"
+
+#include <memory>
+
+//------------------------------------------------------------------------------
+
+using lwt::TreeWalker;
+
+//------------------------------------------------------------------------------
+
+const unsigned TreeWalker::UNLIMITED_DEPTH;
+
+//------------------------------------------------------------------------------
+
+const size_t TreeWalker::BUFFER_SIZE;
+
+//------------------------------------------------------------------------------
+
+const size_t TreeWalker::QUEUE_SIZE;
+
+//------------------------------------------------------------------------------
+
+TreeWalker::Task::Task(TaskGroup& group, TreeWalker& walker) :
+    TaskGroup::Task(group),
+    walker(walker)
+{
+}
+
+//------------------------------------------------------------------------------
+
+bool TreeWalker::Task::execute()
+{
+    // The buffer of ReadDirBulk should be aligned to 8 bytes
+    std::unique_ptr<uint64_t[]> buffer(new uint64_t[BUFFER_SIZE/8]);
+
+    Directory directory;
+    while (walker.takeDirectory(directory)) {
+        walker.read(directory, buffer.get());
+        walker.finishDirectory();
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+TreeWalker::TreeWalker(const std::string& root, size_t numTasks,
+                       unsigned maxDepth) :
+    maxDepth(maxDepth),
+    numReading(0),
+    finished(false),
+    entries(new Channel<Entry, QUEUE_SIZE>())
+{
+    Directory directory;
+    directory.path = root;
+    directory.depth = 0;
+    directories.push_back(directory);
+
+    for(size_t i = 0; i<numTasks; ++i) {
+        tasks.spawn<Task>(*this);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+TreeWalker::~TreeWalker()
+{
+    stop();
+}
+
+//------------------------------------------------------------------------------
+
+bool TreeWalker::next(Entry& entry)
+{
+    if (entries->receive(entry)) return true;
+
+    if (errno==EPIPE) errno = 0;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+void TreeWalker::stop()
+{
+    if (!finished) {
+        finished = true;
+        entries->close();
+        idleTasks.notifyAll();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+bool TreeWalker::shouldDescend(const Entry& /*entry*/)
+{
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool TreeWalker::takeDirectory(Directory& directory)
+{
+    while (!finished && directories.empty()) {
+        if (numReading==0) {
+            stop();
+        } else if (!idleTasks.wait()) {
+            return false;
+        }
+    }
+
+    if (finished) return false;
+
+    directory = std::move(directories.back());
+    directories.pop_back();
+    ++numReading;
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+void TreeWalker::finishDirectory()
+{
+    --numReading;
+    if (numReading==0 && directories.empty()) stop();
+}
+
+//------------------------------------------------------------------------------
+
+void TreeWalker::read(const Directory& directory, void* buffer)
+{
+    int fd = FileSystem::open(directory.path.c_str(),
+                              O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (fd<0) {
+        Entry entry;
+        entry.path = directory.path;
+        entry.type = DT_DIR;
+        entry.depth = directory.depth;
+        entry.errorNumber = errno;
+        send(entry);
+        return;
+    }
+
+    std::string prefix = directory.path;
+    if (prefix.empty() || prefix[prefix.size()-1]!='/') prefix += '/';
+
+    ReadDirBulk reader(fd, buffer, BUFFER_SIZE);
+    ssize_t numEntries = 0;
+    bool sending = true;
+    while (sending && (numEntries = reader.read())>0) {
+        for(struct dirent64* e = reader.getFirst(); e!=0 && sending;
+            e = reader.getNext(e))
+        {
+            Entry entry;
+            entry.path = prefix + e->d_name;
+            entry.type = e->d_type;
+            entry.depth = directory.depth + 1;
+            entry.errorNumber = 0;
+
+            if (entry.type==DT_UNKNOWN) {
+                struct stat st;
+                if (IOServer::call(::fstatat, fd, e->d_name, &st,
+                                   AT_SYMLINK_NOFOLLOW)==0)
+                {
+                    entry.type = IFTODT(st.st_mode);
+                }
+            }
+
+            bool descend = entry.type==DT_DIR && entry.depth<maxDepth &&
+                shouldDescend(entry);
+            Directory subdirectory;
+            if (descend) {
+                subdirectory.path = entry.path;
+                subdirectory.depth = entry.depth;
+            }
+
+            // The subdirectory is read only after it has been sent, so
+            // that its entries come after it
+            sending = send(entry);
+
+            if (sending && descend && !finished) {
+                directories.push_back(std::move(subdirectory));
+                idleTasks.notifyOne();
+            }
+        }
+    }
+
+    if (numEntries<0 && sending) {
+        Entry entry;
+        entry.path = directory.path;
+        entry.type = DT_DIR;
+        entry.depth = directory.depth;
+        entry.errorNumber = errno;
+        send(entry);
+    }
+
+    // The descriptor is closed even if the task has been cancelled
+    Thread::UninterruptibleScope uninterruptibleScope;
+    FileSystem::close(fd);
+}
+
+//------------------------------------------------------------------------------
+
+bool TreeWalker::send(Entry& entry)
+{
+    return !finished && entries->send(std::move(entry));
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,259 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+#ifndef LWT_TREEWALKER_H
+#define LWT_TREEWALKER_H
+//------------------------------------------------------------------------------
+
+#include "Channel.h"
+#include "TaskGroup.h"
+#include "WaitQueue.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A walker of a directory tree that reads several directories in
+ * parallel using the I/O server. A number of tasks take the
+ * directories to read from a common list, read them with
+ * ReadDirBulk, and send the entries to the thread owning the walker
+ * through a bounded channel. Thus the entries are returned in no
+ * particular order, except that the entries of a directory come
+ * after the directory itself. If the owner does not consume the
+ * entries, the tasks wait.
+ *
+ * Symbolic links are not followed. The subdirectories to descend into
+ * can be restricted by a depth limit and by overriding
+ * shouldDescend().
+ *
+ * The walker is small, as the channel is allocated on the heap, so
+ * it can be allocated in the frame of the owner thread, which should
+ * be the only one calling next().
+ */
+class TreeWalker
+{
+public:
+    /**
+     * The depth limit meaning no limit.
+     */
+    static const unsigned UNLIMITED_DEPTH = ~0u;
+
+    /**
+     * The size of the buffer of a task for reading a directory.
+     */
+    static const size_t BUFFER_SIZE = 64*1024;
+
+    /**
+     * The number of entries the channel can hold.
+     */
+    static const size_t QUEUE_SIZE = 256;
+
+    /**
+     * An entry found during the walk.
+     */
+    struct Entry
+    {
+        /// The path of the entry (the root path joined with the names
+        /// of the directories leading to it)
+        std::string path;
+
+        /// The type of the entry (DT_xxx)
+        unsigned char type;
+
+        /// The depth of the entry. The entries in the root directory
+        /// are at depth 1.
+        unsigned depth;
+
+        /// If not 0, the directory denoted by the entry could not be
+        /// read, and this is the error number. Such an entry is
+        /// returned in addition to the one found in the parent
+        /// directory.
+        int errorNumber;
+    };
+
+private:
+    /**
+     * A directory to read.
+     */
+    struct Directory
+    {
+        /// The path of the directory
+        std::string path;
+
+        /// The depth of the directory
+        unsigned depth;
+    };
+
+    /**
+     * A task reading directories.
+     */
+    class Task : public TaskGroup::Task
+    {
+    private:
+        /**
+         * The walker.
+         */
+        TreeWalker& walker;
+
+    public:
+        /**
+         * Construct the task.
+         */
+        Task(TaskGroup& group, TreeWalker& walker);
+
+    protected:
+        /**
+         * Read directories as long as there are any.
+         */
+        virtual bool execute();
+    };
+
+    /**
+     * The maximal depth of the entries returned.
+     */
+    unsigned maxDepth;
+
+    /**
+     * The directories waiting to be read. It is used as a stack, so
+     * that the tree is walked depth-first, which keeps it small.
+     */
+    std::vector<Directory> directories;
+
+    /**
+     * The number of directories being read.
+     */
+    size_t numReading;
+
+    /**
+     * Indicate if the walk has finished or it has been stopped.
+     */
+    bool finished;
+
+    /**
+     * The tasks waiting for a directory to read.
+     */
+    WaitQueue idleTasks;
+
+    /**
+     * The channel of the entries. It is allocated on the heap, since
+     * it is too large for the stack of a thread.
+     */
+    std::unique_ptr<Channel<Entry, QUEUE_SIZE> > entries;
+
+    /**
+     * The group of the tasks. It is destroyed first, so the tasks
+     * are stopped before the other members are destroyed.
+     */
+    TaskGroup tasks;
+
+public:
+    /**
+     * Construct the walker and start walking the tree with the given
+     * root.
+     *
+     * @param numTasks the number of directories read in parallel
+     * @param maxDepth the maximal depth of the entries returned. The
+     * directories at this depth are returned, but they are not read.
+     */
+    TreeWalker(const std::string& root, size_t numTasks = 4,
+               unsigned maxDepth = UNLIMITED_DEPTH);
+
+    /**
+     * Destroy the walker. The walk is stopped, and the tasks are
+     * waited for.
+     */
+    virtual ~TreeWalker();
+
+private:
+    TreeWalker(const TreeWalker&);
+    TreeWalker& operator=(const TreeWalker&);
+
+public:
+    /**
+     * Get the next entry. It waits for an entry, if there is none
+     * available. It obeys the deadline and the cancellation of the
+     * current thread.
+     *
+     * @return if an entry has been returned. If not, errno is 0 at
+     * the end of the walk, or ETIMEDOUT or ECANCELED if the waiting
+     * has failed.
+     */
+    bool next(Entry& entry);
+
+    /**
+     * Stop the walk. The entries already in the channel can still be
+     * retrieved.
+     */
+    void stop();
+
+protected:
+    /**
+     * Determine if the given directory entry should be descended
+     * into. It is called by the tasks for each directory found above
+     * the depth limit. This default implementation returns true.
+     */
+    virtual bool shouldDescend(const Entry& entry);
+
+private:
+    /**
+     * Take a directory to read. If there is none, but some are being
+     * read, wait.
+     *
+     * @return if a directory has been taken. If not, the walk is
+     * over.
+     */
+    bool takeDirectory(Directory& directory);
+
+    /**
+     * Indicate that a directory has been read.
+     */
+    void finishDirectory();
+
+    /**
+     * Read the given directory using the given buffer.
+     */
+    void read(const Directory& directory, void* buffer);
+
+    /**
+     * Send the given entry to the owner.
+     *
+     * @return if the entry could be sent
+     */
+    bool send(Entry& entry);
+};
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_TREEWALKER_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
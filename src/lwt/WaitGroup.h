@@ -0,0 +1,128 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_WAITGROUP_H
+#define LWT_WAITGROUP_H
+//------------------------------------------------------------------------------
+
+#include "WaitQueue.h"
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A counter of outstanding pieces of work that threads can wait for
+ * to reach zero.
+ */
+class WaitGroup
+{
+private:
+    /**
+     * The number of outstanding pieces of work.
+     */
+    size_t count;
+
+    /**
+     * The threads waiting for the count to reach zero.
+     */
+    WaitQueue waiters;
+
+public:
+    /**
+     * Construct the group with the given count.
+     */
+    WaitGroup(size_t count = 0);
+
+    /**
+     * Add the given number to the count.
+     */
+    void add(size_t n = 1);
+
+    /**
+     * Decrement the count. If it reaches zero, the waiting threads are
+     * woken up.
+     */
+    void done();
+
+    /**
+     * Wait for the count to reach zero.
+     *
+     * @return if the count has reached zero. If not, errno is set to
+     * ETIMEDOUT or ECANCELED.
+     */
+    bool wait();
+
+    /**
+     * Get the count.
+     */
+    size_t getCount() const;
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline WaitGroup::WaitGroup(size_t count) :
+    count(count)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline void WaitGroup::add(size_t n)
+{
+    count += n;
+}
+
+//------------------------------------------------------------------------------
+
+inline void WaitGroup::done()
+{
+    assert(count>0);
+    if (--count==0) waiters.notifyAll();
+}
+
+//------------------------------------------------------------------------------
+
+inline bool WaitGroup::wait()
+{
+    return count==0 || waiters.wait();
+}
+
+//------------------------------------------------------------------------------
+
+inline size_t WaitGroup::getCount() const
+{
+    return count;
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_WAITGROUP_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
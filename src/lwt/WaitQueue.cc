@@ -0,0 +1,94 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+//------------------------------------------------------------------------------
+
+#include "WaitQueue.h"
+#include "Scheduler.h"
+
+#include <cerrno>
+
+//------------------------------------------------------------------------------
+
+using lwt::WaitQueue;
+using lwt::BlockedThread;
+using lwt::Thread;
+
+//------------------------------------------------------------------------------
+
+bool WaitQueue::wait()
+{
+    BlockedThread blocker;
+    Thread::block(&blocker, this);
+
+    BlockedThread::result_t result = blocker.result;
+    if (result==BlockedThread::UNBLOCKED) return true;
+
+    errno = (result==BlockedThread::TIMEDOUT) ? ETIMEDOUT : ECANCELED;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+Thread* WaitQueue::notifyOne()
+{
+    Thread* thread = first;
+    if (thread!=0) thread->blocker->unblock();
+    return thread;
+}
+
+//------------------------------------------------------------------------------
+
+size_t WaitQueue::notifyAll()
+{
+    if (first==0) return 0;
+
+    size_t count = 0;
+    Thread* thread = first;
+    do {
+        BlockedThread* blocker = thread->blocker;
+        blocker->result = BlockedThread::UNBLOCKED;
+        blocker->clearThread();
+        thread->blocker = 0;
+        thread->waitQueue = 0;
+        thread = thread->next;
+        ++count;
+    } while (thread!=first);
+
+    Scheduler::get().appendReady(first, last);
+    first = last = 0;
+
+    return count;
+}
+
+//------------------------------------------------------------------------------
+
+void WaitQueue::cancelAll()
+{
+    while (first!=0) {
+        first->blocker->cancel();
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
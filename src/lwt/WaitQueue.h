@@ -0,0 +1,174 @@
+// Copyright (c) 2013 by István Váradi
+
+// This file is part of liblwt, a lightweigtht cooperative threading library
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef LWT_WAITQUEUE_H
+#define LWT_WAITQUEUE_H
+//------------------------------------------------------------------------------
+
+#include "BlockedThread.h"
+#include "Thread.h"
+
+#include <cstddef>
+
+//------------------------------------------------------------------------------
+
+namespace lwt {
+
+//------------------------------------------------------------------------------
+
+/**
+ * A FIFO queue of threads waiting for something. The waiting threads
+ * are linked into the queue via their own list pointers, and their
+ * blocked thread references are on their own stacks, so waiting does
+ * not need any allocation. A waiting thread can time out or be
+ * cancelled, in which case it is removed from the queue.
+ *
+ * This is the building block of the synchronization primitives, like
+ * Mutex or CondVar.
+ */
+class WaitQueue
+{
+private:
+    /**
+     * The first waiting thread.
+     */
+    Thread* first;
+
+    /**
+     * The last waiting thread.
+     */
+    Thread* last;
+
+public:
+    /**
+     * Construct an empty queue.
+     */
+    WaitQueue();
+
+    /**
+     * Destroy the queue. The threads still waiting are unblocked with
+     * the CANCELLED result.
+     */
+    ~WaitQueue();
+
+private:
+    WaitQueue(const WaitQueue&);
+    WaitQueue& operator=(const WaitQueue&);
+
+public:
+    /**
+     * Determine if there are no threads waiting.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Block the current thread at the end of the queue.
+     *
+     * @return if the thread has been notified. If not, errno is set
+     * to ETIMEDOUT or ECANCELED.
+     */
+    bool wait();
+
+    /**
+     * Unblock the first waiting thread.
+     *
+     * @return the thread unblocked, or 0 if there was none
+     */
+    Thread* notifyOne();
+
+    /**
+     * Unblock all waiting threads. They are appended to the ready
+     * list of the scheduler at once, in the order they were waiting.
+     *
+     * @return the number of threads unblocked
+     */
+    size_t notifyAll();
+
+    /**
+     * Unblock all waiting threads with the CANCELLED result.
+     */
+    void cancelAll();
+
+private:
+    /**
+     * Append the given thread to the queue.
+     */
+    void add(Thread* thread);
+
+    /**
+     * Remove the given thread from the queue.
+     */
+    void remove(Thread* thread);
+
+    friend class Thread;
+};
+
+//------------------------------------------------------------------------------
+// Inline definitions
+//------------------------------------------------------------------------------
+
+inline WaitQueue::WaitQueue() :
+    first(0),
+    last(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+inline WaitQueue::~WaitQueue()
+{
+    cancelAll();
+}
+
+//------------------------------------------------------------------------------
+
+inline bool WaitQueue::isEmpty() const
+{
+    return first==0;
+}
+
+//------------------------------------------------------------------------------
+
+inline void WaitQueue::add(Thread* thread)
+{
+    assert(thread->waitQueue==0);
+    thread->append(first, last);
+    thread->waitQueue = this;
+}
+
+//------------------------------------------------------------------------------
+
+inline void WaitQueue::remove(Thread* thread)
+{
+    assert(thread->waitQueue==this);
+    thread->remove(first, last);
+    thread->waitQueue = 0;
+}
+
+//------------------------------------------------------------------------------
+
+} /* namespace lwt */
+
+//------------------------------------------------------------------------------
+#endif // LWT_WAITQUEUE_H
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// End:
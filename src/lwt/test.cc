@@ -22,14 +22,19 @@
 #include "Thread.h"
 #include "Timer.h"
 #include "Scheduler.h"
+#include "Clock.h"
+#include "WaitQueue.h"
 
 #include <cstdio>
+#include <cstring>
 
 //------------------------------------------------------------------------------
 
 using lwt::StackManager;
 using lwt::Scheduler;
 using lwt::Timer;
+using lwt::Clock;
+using lwt::WaitQueue;
 
 //------------------------------------------------------------------------------
 
@@ -72,10 +77,110 @@ void TestThread::run()
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
+/**
+ * A thread that sleeps for long. It is deleted while sleeping.
+ */
+class SleepingThread : public lwt::Thread
+{
+protected:
+    virtual void run();
+};
+
+//------------------------------------------------------------------------------
+
+void SleepingThread::run()
+{
+    Timer::sleep(1000);
+    printf("SleepingThread: woken up after being deleted\n");
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+/**
+ * A thread that waits with a deadline for long. It is deleted while
+ * waiting.
+ */
+class WaitingThread : public lwt::Thread
+{
+protected:
+    virtual void run();
+};
+
+//------------------------------------------------------------------------------
+
+void WaitingThread::run()
+{
+    DeadlineScope deadlineScope(Clock::now() + 1000*NANOS_PER_MILLI);
+    WaitQueue waitQueue;
+    waitQueue.wait();
+    printf("WaitingThread: woken up after being deleted\n");
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+/**
+ * A thread that overwrites its stack, which may have been released
+ * by a deleted thread, and then sleeps, so that the timers are
+ * handled.
+ */
+class StackFillerThread : public lwt::Thread
+{
+protected:
+    virtual void run();
+};
+
+//------------------------------------------------------------------------------
+
+void StackFillerThread::run()
+{
+    volatile char buffer[8192];
+    memset(const_cast<char*>(buffer), 0xab, sizeof(buffer));
+    Timer::sleep(20);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+/**
+ * A thread checking that blocked threads can be deleted. If the
+ * timers on their stacks were left in the wheel, handling them would
+ * crash.
+ */
+class DeleteBlockedThread : public lwt::Thread
+{
+protected:
+    virtual void run();
+};
+
+//------------------------------------------------------------------------------
+
+void DeleteBlockedThread::run()
+{
+    SleepingThread* sleepingThread = new SleepingThread();
+    WaitingThread* waitingThread = new WaitingThread();
+    Timer::sleep(10);
+    delete sleepingThread;
+    delete waitingThread;
+
+    new StackFillerThread();
+    new StackFillerThread();
+    Timer::sleep(1100);
+
+    printf("DeleteBlockedThread: OK\n");
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
 int main()
 {
     Scheduler scheduler;
-    
+
+    new DeleteBlockedThread();
+    scheduler.run();
+
     new TestThread();
 
     scheduler.run();
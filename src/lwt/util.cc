@@ -22,6 +22,7 @@
 #include "util.h"
 
 #include <sys/time.h>
+#include <time.h>
 
 //------------------------------------------------------------------------------
 
@@ -40,3 +41,19 @@ millis_t currentTimeMillis()
 }
 
 //------------------------------------------------------------------------------
+
+nanos_t currentTimeNanos()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    nanos_t nanos = ts.tv_sec;
+
+    nanos *= 1000000000;
+    nanos += ts.tv_nsec;
+
+    return nanos;
+}
+
+//------------------------------------------------------------------------------
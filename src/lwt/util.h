@@ -25,12 +25,34 @@ typedef unsigned long long millis_t;
 
 //------------------------------------------------------------------------------
 
+typedef unsigned long long nanos_t;
+
+//------------------------------------------------------------------------------
+
 const millis_t INVALID_MILLIS = static_cast<millis_t>(-1);
 
 //------------------------------------------------------------------------------
 
+const nanos_t INVALID_NANOS = static_cast<nanos_t>(-1);
+
+//------------------------------------------------------------------------------
+
+const nanos_t NANOS_PER_MILLI = 1000000;
+
+//------------------------------------------------------------------------------
+
+/**
+ * Get the current wall-clock time in milliseconds.
+ */
 millis_t currentTimeMillis();
 
+//------------------------------------------------------------------------------
+
+/**
+ * Get the current time of the monotonic clock in nanoseconds.
+ */
+nanos_t currentTimeNanos();
+
 //------------------------------------------------------------------------------
 #endif // PROXYMUX_UTIL_H
 